@@ -1,3 +1,6 @@
+// clock_gettime, strdup y strtok_r con -std=c11
+#define _POSIX_C_SOURCE 200809L
+
 #include <time.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -5,154 +8,946 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <ctype.h>
+#include <errno.h>
 
-#define DEC_BASE      1000000000u  // base 10^9
-#define DEC_DIGITS    9            // dígitos por bloque
+#include <inttypes.h>
+
+// Multiplicación en paralelo con pthreads (-pthread); -DBG_SIN_HILOS la quita
+#ifndef BG_SIN_HILOS
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#endif
 
+// Núcleos AVX2/AVX-512 del caso base, elegidos al ejecutar; -DBG_SIN_SIMD los quita
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(BG_SIN_SIMD)
+#include <immintrin.h>
+#endif
 
-typedef struct Nodo {
-    uint32_t valor;       // 0 <= valor < DEC_BASE
-    struct Nodo *sig;     // siguiente nodo (más significativo)
-} Nodo;
+#define DEC_BASE      1000000000u  // base 10^9
+#define DEC_DIGITS    9            // dígitos por bloque
 
+// Base de los bloques, elegida al compilar:
+//   -DBG_LIMB_BITS=64  base 2^64 (por defecto si hay unsigned __int128)
+//   -DBG_LIMB_BITS=32  base 2^32
+//   -DBG_DECIMAL       base DEC_BASE = 10^9, la representación original
+// En las bases binarias la conversión a decimal solo ocurre al leer o
+// imprimir; la aritmética usa la palabra completa.
+#if defined(BG_DECIMAL)
+#  undef  BG_LIMB_BITS
+#  define BG_LIMB_BITS 32
+#elif !defined(BG_LIMB_BITS)
+#  ifdef __SIZEOF_INT128__
+#    define BG_LIMB_BITS 64
+#  else
+#    define BG_LIMB_BITS 32
+#  endif
+#endif
+
+#if BG_LIMB_BITS == 64
+typedef uint64_t bg_limb;
+typedef unsigned __int128 bg_dlimb;
+#define BG_TROZO_DEC      10000000000000000000u  // 10^19, mayor potencia de 10 en un bloque
+#define BG_TROZO_DIGITOS  19
+#define BG_FMT_TROZO      "%019" PRIu64
+#define BG_FMT_BLOQUE     "%016" PRIx64
+#elif BG_LIMB_BITS == 32
+typedef uint32_t bg_limb;
+typedef uint64_t bg_dlimb;
+#define BG_TROZO_DEC      DEC_BASE
+#define BG_TROZO_DIGITOS  DEC_DIGITS
+#define BG_FMT_TROZO      "%09" PRIu32
+#  ifdef BG_DECIMAL
+#    define BG_FMT_BLOQUE "%09" PRIu32
+#  else
+#    define BG_FMT_BLOQUE "%08" PRIx32
+#  endif
+#else
+#  error "BG_LIMB_BITS debe ser 32 o 64"
+#endif
+
+// Parte baja y alta de un producto de doble bloque, el mayor bloque, la
+// base como doble bloque y el doble bloque alto*BASE + bajo
+#ifdef BG_DECIMAL
+#define BG_BAJO(t)   ((bg_limb)((t) % DEC_BASE))
+#define BG_ALTO(t)   ((bg_limb)((t) / DEC_BASE))
+#define BG_MAX       ((bg_limb)(DEC_BASE - 1))
+#define BG_BASE      ((bg_dlimb)DEC_BASE)
+#define BG_JUNTAR(alto, bajo) ((bg_dlimb)(alto) * DEC_BASE + (bajo))
+#else
+#define BG_BAJO(t)   ((bg_limb)(t))
+#define BG_ALTO(t)   ((bg_limb)((t) >> BG_LIMB_BITS))
+#define BG_MAX       (~(bg_limb)0)
+#define BG_BASE      ((bg_dlimb)1 << BG_LIMB_BITS)
+#define BG_JUNTAR(alto, bajo) (((bg_dlimb)(alto) << BG_LIMB_BITS) | (bajo))
+#endif
+
+// Ceros a la izquierda y a la derecha y bits encendidos de una palabra de
+// BG_LIMB_BITS bits
+#if BG_LIMB_BITS == 64
+#define BG_CLZ(x)      __builtin_clzll(x)
+#define BG_CTZ(x)      __builtin_ctzll(x)
+#define BG_POPCOUNT(x) __builtin_popcountll(x)
+#else
+#define BG_CLZ(x)      __builtin_clz(x)
+#define BG_CTZ(x)      __builtin_ctz(x)
+#define BG_POPCOUNT(x) __builtin_popcount(x)
+#endif
+
+
+typedef struct BgArena BgArena;
+
+// Los bloques se guardan contiguos en un único buffer que crece según
+// haga falta; bloques[0] es el bloque menos significativo.
 typedef struct {
     int signo;
-    Nodo *cabeza;
-    size_t longitud;
+    bg_limb *bloques;     // 0 <= bloques[i] <= BG_MAX
+    size_t longitud;      // bloques en uso
+    size_t capacidad;     // bloques reservados
+    BgArena *arena;       // NULL si vive en el heap
 } BigInt;
 
 
+// Constructor de resultados: escribe bloques del menos al más
+// significativo sobre capacidad ya reservada, en tiempo lineal.
+typedef struct {
+    BigInt *num;
+    size_t pos;           // siguiente bloque a escribir
+} BgConstructor;
+
+
+BgArena* bg_arena_nueva(void);
+void bg_arena_destruir(BgArena *ar);
+void bg_arena_vaciar(BgArena *ar);
+BgArena* bg_arena_activar(BgArena *ar);
+void bg_liberar_temporales(void);
+void bg_hilos_fijar(int n);
+int bg_hilos(void);
+int bg_perfil_cargar(const char *ruta);
+void bg_afinar(const char *ruta);
+
 BigInt* bg_nuevo(void);
 void bg_liberar(BigInt *a);
-void bg_prepend(BigInt *a, uint32_t v);
-void bg_append(BigInt *a, uint32_t v);
+void bg_reservar(BigInt *a, size_t n);
+void bg_constructor_iniciar(BgConstructor *c, BigInt *destino, size_t estimado);
+BigInt* bg_constructor_terminar(BgConstructor *c);
+void bg_prepend(BigInt *a, bg_limb v);
+void bg_append(BigInt *a, bg_limb v);
 BigInt* bg_desde_cadena(const char *s);
+char* bg_a_cadena(const BigInt *a);
 void printBigInt(const BigInt *a);
 void printBigIntNodes(const BigInt *a);
 int bigInt_compare(const BigInt *a, const BigInt *b);
 void test_tiempos(void);
 
 BigInt* sumar(const BigInt *a, const BigInt *b);
+BigInt* bg_clone(const BigInt *a);
+void bg_add_into(BigInt *dst, const BigInt *a, const BigInt *b);
+void bg_sub_into(BigInt *dst, const BigInt *a, const BigInt *b);
+void bg_addmul_word_into(BigInt *dst, const BigInt *a, bg_limb w);
+void bg_fijar_entero(BigInt *dst, long long v);
+void bg_mul_into(BigInt *dst, const BigInt *a, const BigInt *b);
+void bg_square_into(BigInt *dst, const BigInt *a);
+BigInt* bg_square(const BigInt *a);
+void bg_shl_into(BigInt *dst, const BigInt *a, size_t k);
+void bg_shr_into(BigInt *dst, const BigInt *a, size_t k);
+BigInt* bg_shl(const BigInt *a, size_t k);
+BigInt* bg_shr(const BigInt *a, size_t k);
+void bg_and_into(BigInt *dst, const BigInt *a, const BigInt *b);
+void bg_or_into(BigInt *dst, const BigInt *a, const BigInt *b);
+void bg_xor_into(BigInt *dst, const BigInt *a, const BigInt *b);
+size_t bg_bit_length(const BigInt *a);
+size_t bg_popcount(const BigInt *a);
+int bg_test_bit(const BigInt *a, size_t i);
+BigInt* bg_dividir_binario(const BigInt *dividendo, const BigInt *divisor, BigInt **residuo);
+
+// Módulo precalculado para repetir operaciones con el mismo m (ver
+// "Aritmética modular")
+typedef struct {
+    size_t n;             // bloques de m
+    bg_limb *m;
+    int montgomery;       // 1: restos en forma de Montgomery (por R = BASE^n)
+    bg_limb minv;         // -m^-1 mod BASE
+    bg_limb *r2;          // BASE^(2n) mod m
+    bg_limb f;            // m * f tiene el bloque alto >= BASE/2
+    bg_limb *v;           // m * f
+    bg_limb *x;           // recíproco de v, n+1 bloques
+} BgModulo;
+
+BgModulo* bg_modulo_nuevo(const BigInt *m);
+void bg_modulo_liberar(BgModulo *md);
+void bg_mulmod_into(BigInt *dst, const BigInt *a, const BigInt *b, const BgModulo *md);
+void bg_powmod_into(BigInt *dst, const BigInt *base, const BigInt *e, const BgModulo *md);
+BigInt* bg_powmod(const BigInt *base, const BigInt *e, const BigInt *m);
+
+void bg_gcd_into(BigInt *dst, const BigInt *a, const BigInt *b);
+BigInt* bg_gcd(const BigInt *a, const BigInt *b);
+BigInt* bg_gcdext(const BigInt *a, const BigInt *b, BigInt **s, BigInt **t);
+BigInt* bg_iroot(const BigInt *a, unsigned long k, BigInt **resto);
+BigInt* bg_isqrt(const BigInt *a, BigInt **resto);
+
+BigInt* bg_factorial(unsigned long n);
+BigInt* bg_binomial(unsigned long n, unsigned long k);
+BigInt* bg_primorial(unsigned long n);
+
+// Serie de tipo hipergeométrico para bg_serie; el término k es
+//   a(k) / b(k) * p(0) p(1) ... p(k) / (q(0) q(1) ... q(k))
+// Cada función deja su valor en r; b puede ser NULL (b(k) = 1).
+typedef struct {
+    void (*a)(BigInt *r, unsigned long k, void *datos);
+    void (*b)(BigInt *r, unsigned long k, void *datos);
+    void (*p)(BigInt *r, unsigned long k, void *datos);
+    void (*q)(BigInt *r, unsigned long k, void *datos);
+    void *datos;
+} BgSerie;
+
+void bg_serie(const BgSerie *s, unsigned long n1, unsigned long n2,
+              BigInt *P, BigInt *Q, BigInt *B, BigInt *T);
+
+// Racional num / den con den > 0 y el signo en num (ver la sección de
+// racionales)
+typedef struct {
+    BigInt *num;
+    BigInt *den;
+    int reducido;         // 1 si se sabe que gcd(num, den) = 1
+    size_t presupuesto;   // bloques hasta los que se aplaza la reducción
+} BigRat;
+
+BigRat* bg_rat_nuevo(void);
+void bg_rat_liberar(BigRat *q);
+void bg_rat_fijar(BigRat *q, const BigInt *num, const BigInt *den);
+BigRat* bg_rat_desde_cadena(const char *s);
+char* bg_rat_a_cadena(BigRat *q);
+void bg_rat_reducir(BigRat *q);
+void bg_rat_add_into(BigRat *dst, const BigRat *a, const BigRat *b);
+void bg_rat_sub_into(BigRat *dst, const BigRat *a, const BigRat *b);
+void bg_rat_mul_into(BigRat *dst, const BigRat *a, const BigRat *b);
+void bg_rat_div_into(BigRat *dst, const BigRat *a, const BigRat *b);
+int bg_rat_comparar(const BigRat *a, const BigRat *b);
+
+// Polinomio denso con coeficientes BigInt (ver la sección de polinomios)
+typedef struct {
+    BigInt *c;            // c[i] es el coeficiente de x^i
+    size_t longitud;      // grado + 1; 0 para el polinomio cero
+    size_t capacidad;
+    BgArena *arena;       // de los bloques de los coeficientes
+} BigPoli;
+
+BigPoli* bg_poli_nuevo(void);
+void bg_poli_liberar(BigPoli *p);
+long bg_poli_grado(const BigPoli *p);
+void bg_poli_fijar_coef(BigPoli *p, size_t i, const BigInt *v);
+BigPoli* bg_poli_desde_cadena(const char *s);
+char* bg_poli_a_cadena(const BigPoli *p);
+void bg_poli_add_into(BigPoli *dst, const BigPoli *a, const BigPoli *b);
+void bg_poli_sub_into(BigPoli *dst, const BigPoli *a, const BigPoli *b);
+void bg_poli_mul_into(BigPoli *dst, const BigPoli *a, const BigPoli *b);
+void bg_poli_pseudo_divrem(const BigPoli *a, const BigPoli *b, BigPoli *q, BigPoli *r);
+void bg_poli_gcd_into(BigPoli *dst, const BigPoli *a, const BigPoli *b);
+
+// Operación de un lote; r (y resto en la división) los rellena bg_lote
+typedef enum { BG_SUMAR, BG_RESTAR, BG_MULTIPLICAR, BG_CUADRADO, BG_DIVIDIR } BgOperacion;
+
+typedef struct {
+    BgOperacion op;
+    const BigInt *a, *b;  // b no se usa en BG_CUADRADO
+    BigInt *r;            // resultado (cociente en BG_DIVIDIR)
+    BigInt *resto;        // residuo en BG_DIVIDIR, NULL en las demás
+} BgTrabajo;
+
+void bg_lote(BgTrabajo *trabajos, size_t n);
+
+// Contadores de instrumentación, solo con -DBG_CONTADORES. Cada hilo
+// lleva los suyos y bg_contadores_leer los junta; sin la opción no se
+// cuenta nada y la lectura da ceros.
+typedef enum {
+    BG_NIVEL_ESCOLAR, BG_NIVEL_ESCOLAR_SQR, BG_NIVEL_KARATSUBA,
+    BG_NIVEL_KARATSUBA_SQR, BG_NIVEL_TOOM3, BG_NIVEL_TOOM32, BG_NIVEL_TROCEO,
+    BG_NIVEL_NTT, BG_NIVEL_DIV_1, BG_NIVEL_KNUTH, BG_NIVEL_NEWTON,
+    BG_NIVEL_CONV_BASICA, BG_NIVEL_CONV_RECURSIVA, BG_NIVELES
+} BgNivel;
+
+typedef enum {
+    BG_OP_SUMAR, BG_OP_RESTAR, BG_OP_MULTIPLICAR, BG_OP_CUADRADO,
+    BG_OP_DIVIDIR, BG_OP_LEER, BG_OP_ESCRIBIR, BG_OP_POTMOD, BG_OP_GCD, BG_OP_RAIZ,
+    BG_OP_PRODUCTO, BG_OP_RACIONAL, BG_OP_POLINOMIO, BG_OPS
+} BgOpContada;
+
+typedef struct {
+    uint64_t reservas;                 // malloc y realloc de BigInt y de arenas
+    uint64_t bytes_reservados;
+    int64_t  bytes_vivos, bytes_pico;  // reservados menos liberados, y su máximo
+    uint64_t buffers_arena;            // buffers de bloques repartidos por arenas
+    uint64_t buffers_reciclados;       // de ellos, los sacados de la lista libre
+    uint64_t ops_bloque;               // operaciones de un bloque en los núcleos
+    uint64_t correcciones_div;         // ajustes del cociente estimado
+    uint64_t llamadas[BG_NIVELES];     // entradas a cada algoritmo
+    uint64_t profundidad_max;          // recursión de la multiplicación
+    uint64_t operaciones[BG_OPS];      // operaciones públicas, sin contar las anidadas
+    double   segundos[BG_OPS];
+} BgContadores;
+
+void bg_contadores_leer(BgContadores *c, int con_grupo);
+void bg_contadores_reiniciar(void);
+void bg_contadores_volcar(FILE *f, const BgContadores *c);
+
 void test_suma(void);
 
 void test_bigInt_compare(void);
 void test_printBigIntNodes(void);
 
 
-BigInt* bg_nuevo(void) {
-    BigInt *z = malloc(sizeof(BigInt));
-    z->signo    = +1;
-    z->cabeza   = NULL;
-    z->longitud = 0;
-    return z;
+// ---------------------------------------------------------------------
+// Contadores
+//
+// Con -DBG_CONTADORES cada hilo suma en su propio BgContadores, sin
+// cerrojos ni atómicos, y las macros BG_CONTAR* marcan los puntos que se
+// cuentan: reservas del sistema, buffers de las arenas, operaciones de
+// bloque en los núcleos, entradas a cada algoritmo, profundidad de la
+// recursión y tiempo de las operaciones públicas. Sin la opción las
+// macros no generan código y no evalúan sus argumentos.
+// ---------------------------------------------------------------------
+
+#ifdef BG_CONTADORES
+
+static _Thread_local BgContadores bg_cont;
+static _Thread_local uint64_t bg_cont_profundidad;
+static _Thread_local int bg_cont_dentro;   // operaciones públicas en curso
+
+#  define BG_CONTAR(campo, n)      (bg_cont.campo += (n))
+#  define BG_CONTAR_NIVEL(nivel)   (bg_cont.llamadas[nivel]++)
+#  define BG_CONTAR_LIBERA(bytes)  (bg_cont.bytes_vivos -= (int64_t)(bytes))
+#  define BG_CONTAR_RESERVA(bytes, antes) bg_cont_reserva((bytes), (antes))
+#  define BG_RECURSION_ENTRAR()    bg_cont_entrar_nivel()
+#  define BG_RECURSION_SALIR()     (bg_cont_profundidad--)
+#  define BG_OP_INICIO()           double bg_op_inicio_ = bg_cont_op_inicio()
+#  define BG_OP_FIN(op)            bg_cont_op_fin((op), bg_op_inicio_)
+
+// Reserva de bytes que sustituye a otra de antes bytes (realloc)
+static void bg_cont_reserva(size_t bytes, size_t antes) {
+    bg_cont.reservas++;
+    bg_cont.bytes_reservados += bytes;
+    bg_cont.bytes_vivos += (int64_t)bytes - (int64_t)antes;
+    if (bg_cont.bytes_vivos > bg_cont.bytes_pico) bg_cont.bytes_pico = bg_cont.bytes_vivos;
 }
 
+static void bg_cont_entrar_nivel(void) {
+    if (++bg_cont_profundidad > bg_cont.profundidad_max)
+        bg_cont.profundidad_max = bg_cont_profundidad;
+}
 
-void bg_liberar(BigInt *a) {
-    Nodo *p = a->cabeza;
-    while (p) {
-        Nodo *s = p->sig;
-        free(p);
-        p = s;
+static double bg_cont_op_inicio(void) {
+    if (bg_cont_dentro++) return 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Solo cuenta la operación más externa: bg_mul_into dentro de una
+// división es parte de la división
+static void bg_cont_op_fin(BgOpContada op, double inicio) {
+    if (--bg_cont_dentro) return;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    bg_cont.operaciones[op]++;
+    bg_cont.segundos[op] += ts.tv_sec + ts.tv_nsec * 1e-9 - inicio;
+}
+
+// a += b. Los picos de hilos distintos no tienen por qué coincidir en el
+// tiempo, así que su suma es una cota superior del pico conjunto.
+static void bg_cont_juntar(BgContadores *a, const BgContadores *b) {
+    a->reservas += b->reservas;
+    a->bytes_reservados += b->bytes_reservados;
+    a->bytes_vivos += b->bytes_vivos;
+    a->bytes_pico += b->bytes_pico;
+    a->buffers_arena += b->buffers_arena;
+    a->buffers_reciclados += b->buffers_reciclados;
+    a->ops_bloque += b->ops_bloque;
+    a->correcciones_div += b->correcciones_div;
+    for (int i = 0; i < BG_NIVELES; i++) a->llamadas[i] += b->llamadas[i];
+    if (b->profundidad_max > a->profundidad_max) a->profundidad_max = b->profundidad_max;
+    for (int i = 0; i < BG_OPS; i++) {
+        a->operaciones[i] += b->operaciones[i];
+        a->segundos[i] += b->segundos[i];
     }
-    free(a);
 }
 
-// Inserta un bloque al inicio (más bajo peso)
-void bg_prepend(BigInt *a, uint32_t v) {
-    Nodo *n = malloc(sizeof(Nodo));
-    n->valor = v;
-    n->sig   = a->cabeza;
-    a->cabeza = n;
-    a->longitud++;
+#else
+
+#  define BG_CONTAR(campo, n)      ((void)0)
+#  define BG_CONTAR_NIVEL(nivel)   ((void)0)
+#  define BG_CONTAR_LIBERA(bytes)  ((void)0)
+#  define BG_CONTAR_RESERVA(bytes, antes) ((void)0)
+#  define BG_RECURSION_ENTRAR()    ((void)0)
+#  define BG_RECURSION_SALIR()     ((void)0)
+#  define BG_OP_INICIO()           ((void)0)
+#  define BG_OP_FIN(op)            ((void)0)
+
+#endif /* BG_CONTADORES */
+
+// ---------------------------------------------------------------------
+// Arena de memoria temporal
+//
+// Una arena toma memoria del sistema en trozos grandes y la reparte por
+// desplazamiento. Los buffers devueltos con bg_liberar pasan a una lista
+// libre por tamaño (potencias de dos) y se reutilizan sin llamar a
+// malloc; bg_arena_vaciar descarta todo de una vez y conserva los trozos
+// para la siguiente ronda.
+//
+// Mientras una arena está activa (bg_arena_activar) todos los BigInt
+// nuevos del hilo se crean en ella. Karatsuba y la división larga usan
+// una arena temporal propia del hilo y copian el resultado final fuera
+// de ella antes de vaciarla.
+// ---------------------------------------------------------------------
+
+#define BG_ARENA_TROZO_MIN  (64 * 1024)
+#define BG_ARENA_CLASES     64
+
+typedef struct BgTrozo {
+    struct BgTrozo *sig;
+    size_t tam;
+    size_t usado;
+    max_align_t datos[];
+} BgTrozo;
+
+typedef struct BgLibre {
+    struct BgLibre *sig;
+} BgLibre;
+
+struct BgArena {
+    BgTrozo *primero;
+    BgTrozo *actual;
+    BgLibre *libres[BG_ARENA_CLASES];   // buffers de 2^k bloques
+    BgLibre *cabeceras;                 // estructuras BigInt libres
+};
+
+static _Thread_local BgArena *arena_activa = NULL;
+static _Thread_local BgArena *arena_temporal = NULL;
+static _Thread_local int profundidad_temporal = 0;
+
+static BgTrozo* bg_trozo_nuevo(size_t tam) {
+    BgTrozo *t = malloc(sizeof(BgTrozo) + tam);
+    if (!t) {
+        fprintf(stderr, "Error: no se pudo reservar memoria\n");
+        exit(1);
+    }
+    BG_CONTAR_RESERVA(sizeof(BgTrozo) + tam, 0);
+    t->sig   = NULL;
+    t->tam   = tam;
+    t->usado = 0;
+    return t;
 }
 
-void bg_append(BigInt *a, uint32_t v) {
-    Nodo *n = malloc(sizeof(Nodo));
-    n->valor = v;
-    n->sig   = NULL;
-    if (!a->cabeza) {
-        a->cabeza = n;
-    } else {
-        Nodo *q = a->cabeza;
-        while (q->sig) q = q->sig;
-        q->sig = n;
+BgArena* bg_arena_nueva(void) {
+    BgArena *ar = calloc(1, sizeof(BgArena));
+    ar->primero = ar->actual = bg_trozo_nuevo(BG_ARENA_TROZO_MIN);
+    return ar;
+}
+
+void bg_arena_destruir(BgArena *ar) {
+    if (!ar) return;
+    if (arena_activa == ar) arena_activa = NULL;
+    BgTrozo *t = ar->primero;
+    while (t) {
+        BgTrozo *s = t->sig;
+        BG_CONTAR_LIBERA(sizeof(BgTrozo) + t->tam);
+        free(t);
+        t = s;
     }
-    a->longitud++;
+    free(ar);
 }
 
+// Libera en bloque todo lo reservado en la arena; los BigInt creados en
+// ella dejan de ser válidos.
+void bg_arena_vaciar(BgArena *ar) {
+    for (BgTrozo *t = ar->primero; t; t = t->sig)
+        t->usado = 0;
+    ar->actual = ar->primero;
+    memset(ar->libres, 0, sizeof(ar->libres));
+    ar->cabeceras = NULL;
+}
 
-BigInt* bg_desde_cadena(const char *s) {
-    BigInt *r = bg_nuevo();
-    if (*s=='+'||*s=='-') {
-        if (*s=='-') r->signo = -1;
-        s++;
+// Hace que los BigInt nuevos del hilo se creen en 'ar' (NULL = heap).
+// Devuelve la arena que estaba activa para poder restaurarla.
+BgArena* bg_arena_activar(BgArena *ar) {
+    BgArena *previa = arena_activa;
+    arena_activa = ar;
+    return previa;
+}
+
+// Reserva por desplazamiento, pasando al siguiente trozo si no cabe
+static void* bg_arena_reservar(BgArena *ar, size_t bytes) {
+    bytes = (bytes + sizeof(max_align_t) - 1) & ~(sizeof(max_align_t) - 1);
+    BgTrozo *t = ar->actual;
+    while (t->usado + bytes > t->tam) {
+        if (t->sig && t->sig->tam >= bytes) {
+            t = t->sig;
+            t->usado = 0;
+        } else {
+            size_t tam = t->tam * 2;
+            if (tam < bytes) tam = bytes;
+            BgTrozo *n = bg_trozo_nuevo(tam);
+            n->sig = t->sig;
+            t->sig = n;
+            t = n;
+        }
     }
-    size_t len = strlen(s);
-    for (int i = (int)len; i > 0; i -= DEC_DIGITS) {
-        int start = i - DEC_DIGITS;
-        if (start < 0) start = 0;
-        char buf[DEC_DIGITS+1] = {0};
-        memcpy(buf, s + start, i - start);
-        uint32_t bloque = (uint32_t)atoi(buf);
-        bg_append(r, bloque);
+    ar->actual = t;
+    void *p = (unsigned char *)t->datos + t->usado;
+    t->usado += bytes;
+    return p;
+}
+
+static unsigned bg_clase(size_t cap) {
+    unsigned k = 0;
+    while (((size_t)1 << k) < cap) k++;
+    return k;
+}
+
+// Buffer de exactamente 'cap' bloques (potencia de dos)
+static bg_limb* bg_arena_bloques(BgArena *ar, size_t cap) {
+    unsigned k = bg_clase(cap);
+    BgLibre *l = ar->libres[k];
+    BG_CONTAR(buffers_arena, 1);
+    if (l) {
+        BG_CONTAR(buffers_reciclados, 1);
+        ar->libres[k] = l->sig;
+        return (bg_limb *)l;
     }
-    if (r->longitud == 0)
-        bg_append(r, 0);
-    return r;
+    size_t bytes = cap * sizeof(bg_limb);
+    if (bytes < sizeof(BgLibre)) bytes = sizeof(BgLibre);
+    return bg_arena_reservar(ar, bytes);
 }
 
+static void bg_arena_devolver(BgArena *ar, bg_limb *bloques, size_t cap) {
+    if (!bloques) return;
+    BgLibre *l = (BgLibre *)bloques;
+    unsigned k = bg_clase(cap);
+    l->sig = ar->libres[k];
+    ar->libres[k] = l;
+}
 
-void printBigInt(const BigInt *a) {
-    uint32_t *bloques = malloc(a->longitud * sizeof(uint32_t));
-    size_t n = 0;
-    for (Nodo *p = a->cabeza; p; p = p->sig)
-        bloques[n++] = p->valor;
+// Abre un ámbito temporal del hilo; devuelve la arena que estaba activa
+static BgArena* bg_temporal_abrir(void) {
+    if (!arena_temporal) arena_temporal = bg_arena_nueva();
+    profundidad_temporal++;
+    return bg_arena_activar(arena_temporal);
+}
 
-    if (a->signo < 0) putchar('-');
-    printf("%u", bloques[n-1]);
-    for (int i = (int)n-2; i >= 0; i--)
-        printf("%09u", bloques[i]);
-    putchar('\n');
-    free(bloques);
+// Cierra el ámbito; al salir del más externo se libera todo en bloque
+static void bg_temporal_cerrar(BgArena *previa) {
+    bg_arena_activar(previa);
+    if (--profundidad_temporal == 0)
+        bg_arena_vaciar(arena_temporal);
 }
 
+// Espacio de trabajo de al menos n bloques dentro de un ámbito temporal
+static bg_limb* bg_trabajo_pedir(size_t n, size_t *cap) {
+    size_t c = 4;
+    while (c < n) c *= 2;
+    *cap = c;
+    return bg_arena_bloques(arena_temporal, c);
+}
 
-void printBigIntNodes(const BigInt *a) {
-    int idx = 0;
-    for (Nodo *p = a->cabeza; p; p = p->sig) {
-        printf("  Nodo %2d: %0*u\n",
-               idx++, DEC_DIGITS, p->valor);
+static void bg_trabajo_devolver(bg_limb *bloques, size_t cap) {
+    bg_arena_devolver(arena_temporal, bloques, cap);
+}
+
+// Devuelve al sistema la memoria de la arena temporal del hilo
+void bg_liberar_temporales(void) {
+    if (profundidad_temporal == 0) {
+        bg_arena_destruir(arena_temporal);
+        arena_temporal = NULL;
+    }
+}
+
+// ---------------------------------------------------------------------
+// Hilos: subproductos en paralelo con robo de trabajo
+//
+// Con bg_hilos_fijar(n), n > 1, los niveles recursivos de la
+// multiplicación lanzan sus subproductos independientes como tareas
+// cuando el operando llega a PARALELO_UMBRAL bloques. Cada hilo del
+// grupo tiene una cola doble: mete y saca sus tareas por abajo y, si se
+// queda sin trabajo, roba por arriba de la cola de otro. Los hilos ajenos
+// al grupo (el programa principal) comparten una cola más. Quien espera
+// una tarea no se bloquea: ejecuta trabajo pendiente, suyo o robado,
+// hasta que termina, así que no hay interbloqueos por profundo que sea el
+// árbol. Cada tarea pide su espacio de trabajo a la arena temporal del
+// hilo que la ejecuta.
+//
+// El resultado no depende del reparto: cada subproducto se escribe en su
+// propio sitio y las sumas se hacen después de esperar, en el mismo orden
+// que sin hilos. Con -DBG_SIN_HILOS todo esto se reduce a llamadas
+// directas.
+// ---------------------------------------------------------------------
+
+typedef struct BgTarea BgTarea;
+struct BgTarea {
+    void (*fn)(BgTarea *);
+#ifndef BG_SIN_HILOS
+    atomic_int hecha;
+#endif
+};
+
+#ifndef PARALELO_UMBRAL
+#define PARALELO_UMBRAL 1024   // bloques del operando menor
+#endif
+
+#ifdef BG_SIN_HILOS
+
+void bg_hilos_fijar(int n) { (void)n; }
+int bg_hilos(void) { return 1; }
+static int bg_en_paralelo(size_t n) { (void)n; return 0; }
+static void bg_tarea_lanzar(BgTarea *t) { t->fn(t); }
+static void bg_tarea_esperar(BgTarea *t) { (void)t; }
+
+#else
+
+#define BG_HILOS_MAX  256
+#define BG_COLA_TAM   1024     // tareas pendientes por cola
+
+typedef struct {
+    pthread_mutex_t cerrojo;
+    size_t arriba, abajo;      // tareas pendientes en [arriba, abajo)
+    BgTarea *tareas[BG_COLA_TAM];
+} BgCola;
+
+// Colas 0..bg_num_hilos-2 de los hilos del grupo; la BG_HILOS_MAX es la
+// compartida por los hilos ajenos
+static BgCola bg_colas[BG_HILOS_MAX + 1];
+static pthread_t bg_grupo[BG_HILOS_MAX];
+static int bg_num_hilos = 1;
+static int bg_colas_listas = 0;
+static atomic_int bg_pendientes;
+static atomic_int bg_parar;
+static pthread_mutex_t bg_dormir = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bg_despertar = PTHREAD_COND_INITIALIZER;
+static _Thread_local int bg_cola_propia = BG_HILOS_MAX;
+
+#ifdef BG_CONTADORES
+// Contadores de los hilos vivos del grupo y lo acumulado por los que ya
+// terminaron, para que bg_contadores_leer pueda juntarlos
+static BgContadores *bg_cont_grupo[BG_HILOS_MAX];
+static BgContadores bg_cont_retirados;
+static pthread_mutex_t bg_cont_cerrojo = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static int bg_en_paralelo(size_t n) {
+    return bg_num_hilos > 1 && n >= PARALELO_UMBRAL;
+}
+
+static void bg_tarea_ejecutar(BgTarea *t) {
+    t->fn(t);
+    atomic_store_explicit(&t->hecha, 1, memory_order_release);
+}
+
+// Saca la tarea más reciente de la cola propia o roba la más antigua de
+// otra; NULL si no hay ninguna
+static BgTarea* bg_tarea_buscar(void) {
+    int propia = bg_cola_propia;
+    BgCola *c = &bg_colas[propia];
+    BgTarea *t = NULL;
+    pthread_mutex_lock(&c->cerrojo);
+    if (c->abajo > c->arriba) t = c->tareas[--c->abajo % BG_COLA_TAM];
+    pthread_mutex_unlock(&c->cerrojo);
+
+    for (int i = 0; !t && i < bg_num_hilos; i++) {
+        int v = i == bg_num_hilos - 1 ? BG_HILOS_MAX : i;
+        if (v == propia) continue;
+        c = &bg_colas[v];
+        pthread_mutex_lock(&c->cerrojo);
+        if (c->abajo > c->arriba) t = c->tareas[c->arriba++ % BG_COLA_TAM];
+        pthread_mutex_unlock(&c->cerrojo);
+    }
+    if (t) atomic_fetch_sub(&bg_pendientes, 1);
+    return t;
+}
+
+// Ofrece la tarea a los demás hilos; si la cola está llena la ejecuta ya
+static void bg_tarea_lanzar(BgTarea *t) {
+    atomic_init(&t->hecha, 0);
+    BgCola *c = &bg_colas[bg_cola_propia];
+    pthread_mutex_lock(&c->cerrojo);
+    int cabe = c->abajo - c->arriba < BG_COLA_TAM;
+    if (cabe) c->tareas[c->abajo++ % BG_COLA_TAM] = t;
+    pthread_mutex_unlock(&c->cerrojo);
+    if (!cabe) {
+        bg_tarea_ejecutar(t);
+        return;
+    }
+    atomic_fetch_add(&bg_pendientes, 1);
+    pthread_mutex_lock(&bg_dormir);
+    pthread_cond_signal(&bg_despertar);
+    pthread_mutex_unlock(&bg_dormir);
+}
+
+// Espera a que t termine ejecutando trabajo pendiente mientras tanto
+static void bg_tarea_esperar(BgTarea *t) {
+    while (!atomic_load_explicit(&t->hecha, memory_order_acquire)) {
+        BgTarea *otra = bg_tarea_buscar();
+        if (otra) bg_tarea_ejecutar(otra);
+        else      sched_yield();
     }
 }
 
-static int compararMagnitud(const Nodo *na, const Nodo *nb, size_t longitud) {
-    uint32_t *valores_a = malloc(longitud * sizeof(uint32_t));
-    uint32_t *valores_b = malloc(longitud * sizeof(uint32_t));
+static void* bg_hilo_trabajar(void *arg) {
+    bg_cola_propia = (int)(intptr_t)arg;
+#ifdef BG_CONTADORES
+    pthread_mutex_lock(&bg_cont_cerrojo);
+    bg_cont_grupo[bg_cola_propia] = &bg_cont;
+    pthread_mutex_unlock(&bg_cont_cerrojo);
+#endif
+    while (!atomic_load(&bg_parar)) {
+        BgTarea *t = bg_tarea_buscar();
+        if (t) {
+            bg_tarea_ejecutar(t);
+            continue;
+        }
+        pthread_mutex_lock(&bg_dormir);
+        while (atomic_load(&bg_pendientes) == 0 && !atomic_load(&bg_parar))
+            pthread_cond_wait(&bg_despertar, &bg_dormir);
+        pthread_mutex_unlock(&bg_dormir);
+    }
+    bg_liberar_temporales();
+#ifdef BG_CONTADORES
+    pthread_mutex_lock(&bg_cont_cerrojo);
+    bg_cont_juntar(&bg_cont_retirados, &bg_cont);
+    bg_cont_grupo[bg_cola_propia] = NULL;
+    pthread_mutex_unlock(&bg_cont_cerrojo);
+#endif
+    return NULL;
+}
 
-    const Nodo *pa = na, *pb = nb;
-    for (size_t i = 0; i < longitud; i++) {
-        valores_a[i] = pa->valor;
-        valores_b[i] = pb->valor;
-        pa = pa->sig;
-        pb = pb->sig;
+// Fija los hilos de la multiplicación: n <= 1 la deja secuencial y n = 0
+// usa todos los procesadores. No debe llamarse con una operación en curso.
+void bg_hilos_fijar(int n) {
+    if (n == 0) n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) n = 1;
+    if (n > BG_HILOS_MAX) n = BG_HILOS_MAX;
+    if (!bg_colas_listas) {
+        for (int i = 0; i <= BG_HILOS_MAX; i++)
+            pthread_mutex_init(&bg_colas[i].cerrojo, NULL);
+        bg_colas_listas = 1;
     }
 
-    for (int i = (int)longitud - 1; i >= 0; i--) {
-        if (valores_a[i] > valores_b[i]) {
-            free(valores_a);
-            free(valores_b);
-            return 1;
+    // Parar el grupo anterior
+    pthread_mutex_lock(&bg_dormir);
+    atomic_store(&bg_parar, 1);
+    pthread_cond_broadcast(&bg_despertar);
+    pthread_mutex_unlock(&bg_dormir);
+    for (int i = 0; i < bg_num_hilos - 1; i++)
+        pthread_join(bg_grupo[i], NULL);
+    atomic_store(&bg_parar, 0);
+
+    bg_num_hilos = n;
+    for (int i = 0; i < n - 1; i++) {
+        if (pthread_create(&bg_grupo[i], NULL, bg_hilo_trabajar, (void *)(intptr_t)i) != 0) {
+            bg_num_hilos = i + 1;
+            break;
         }
-        if (valores_a[i] < valores_b[i]) {
-            free(valores_a);
-            free(valores_b);
-            return -1;
+    }
+}
+
+int bg_hilos(void) {
+    return bg_num_hilos;
+}
+
+#endif /* BG_SIN_HILOS */
+
+// Copia los contadores del hilo que llama en c; con con_grupo suma los
+// de los hilos del grupo, vivos o ya parados. Los de un hilo en plena
+// operación pueden leerse a medio actualizar: para cifras exactas, leer
+// entre operaciones. Sin -DBG_CONTADORES todo queda a cero.
+void bg_contadores_leer(BgContadores *c, int con_grupo) {
+    memset(c, 0, sizeof *c);
+#ifdef BG_CONTADORES
+    bg_cont_juntar(c, &bg_cont);
+#  ifndef BG_SIN_HILOS
+    if (con_grupo) {
+        pthread_mutex_lock(&bg_cont_cerrojo);
+        bg_cont_juntar(c, &bg_cont_retirados);
+        for (int i = 0; i < BG_HILOS_MAX; i++)
+            if (bg_cont_grupo[i] && bg_cont_grupo[i] != &bg_cont)
+                bg_cont_juntar(c, bg_cont_grupo[i]);
+        pthread_mutex_unlock(&bg_cont_cerrojo);
+    }
+#  endif
+#endif
+    (void)con_grupo;
+}
+
+// Pone a cero los contadores del hilo que llama y los del grupo. Los
+// bytes vivos se conservan: la memoria sigue reservada y al liberarla se
+// descuenta.
+void bg_contadores_reiniciar(void) {
+#ifdef BG_CONTADORES
+    int64_t vivos = bg_cont.bytes_vivos;
+    memset(&bg_cont, 0, sizeof bg_cont);
+    bg_cont.bytes_vivos = bg_cont.bytes_pico = vivos;
+#  ifndef BG_SIN_HILOS
+    pthread_mutex_lock(&bg_cont_cerrojo);
+    memset(&bg_cont_retirados, 0, sizeof bg_cont_retirados);
+    for (int i = 0; i < BG_HILOS_MAX; i++)
+        if (bg_cont_grupo[i] && bg_cont_grupo[i] != &bg_cont) {
+            vivos = bg_cont_grupo[i]->bytes_vivos;
+            memset(bg_cont_grupo[i], 0, sizeof *bg_cont_grupo[i]);
+            bg_cont_grupo[i]->bytes_vivos = bg_cont_grupo[i]->bytes_pico = vivos;
         }
+    pthread_mutex_unlock(&bg_cont_cerrojo);
+#  endif
+#endif
+}
+
+// Escribe c en f como un objeto JSON de una línea
+void bg_contadores_volcar(FILE *f, const BgContadores *c) {
+    static const char *niveles[BG_NIVELES] = {
+        "escolar", "escolar_sqr", "karatsuba", "karatsuba_sqr", "toom3", "toom32",
+        "troceo", "ntt", "div_1", "knuth", "newton", "conv_basica", "conv_recursiva"
+    };
+    static const char *ops[BG_OPS] = {
+        "sumar", "restar", "multiplicar", "cuadrado", "dividir", "leer", "escribir",
+        "potmod", "gcd", "raiz", "producto", "racional", "polinomio"
+    };
+    fprintf(f, "{\"reservas\":%" PRIu64 ",\"bytes_reservados\":%" PRIu64
+            ",\"bytes_vivos\":%" PRId64 ",\"bytes_pico\":%" PRId64
+            ",\"buffers_arena\":%" PRIu64 ",\"buffers_reciclados\":%" PRIu64
+            ",\"ops_bloque\":%" PRIu64 ",\"correcciones_div\":%" PRIu64
+            ",\"profundidad_max\":%" PRIu64 ",\"llamadas\":{",
+            c->reservas, c->bytes_reservados, c->bytes_vivos, c->bytes_pico,
+            c->buffers_arena, c->buffers_reciclados, c->ops_bloque,
+            c->correcciones_div, c->profundidad_max);
+    for (int i = 0; i < BG_NIVELES; i++)
+        fprintf(f, "%s\"%s\":%" PRIu64, i ? "," : "", niveles[i], c->llamadas[i]);
+    fputs("},\"operaciones\":{", f);
+    for (int i = 0; i < BG_OPS; i++)
+        fprintf(f, "%s\"%s\":{\"n\":%" PRIu64 ",\"segundos\":%.9f}", i ? "," : "",
+                ops[i], c->operaciones[i], c->segundos[i]);
+    fputs("}}\n", f);
+}
+
+BigInt* bg_nuevo(void) {
+    BgArena *ar = arena_activa;
+    BigInt *z;
+    if (ar && ar->cabeceras) {
+        z = (BigInt *)ar->cabeceras;
+        ar->cabeceras = ar->cabeceras->sig;
+    } else if (ar) {
+        z = bg_arena_reservar(ar, sizeof(BigInt));
+    } else {
+        z = malloc(sizeof(BigInt));
+        BG_CONTAR_RESERVA(sizeof(BigInt), 0);
+    }
+    z->signo     = +1;
+    z->bloques   = NULL;
+    z->longitud  = 0;
+    z->capacidad = 0;
+    z->arena     = ar;
+    return z;
+}
+
+
+void bg_liberar(BigInt *a) {
+    BgArena *ar = a->arena;
+    if (ar) {
+        bg_arena_devolver(ar, a->bloques, a->capacidad);
+        BgLibre *l = (BgLibre *)a;
+        l->sig = ar->cabeceras;
+        ar->cabeceras = l;
+        return;
+    }
+    BG_CONTAR_LIBERA(sizeof(BigInt) + a->capacidad * sizeof(bg_limb));
+    free(a->bloques);
+    free(a);
+}
+
+// Garantiza espacio para al menos 'minimo' bloques, duplicando la capacidad
+static void bg_crecer(BigInt *a, size_t minimo) {
+    if (minimo <= a->capacidad) return;
+    if (a->arena) {
+        size_t cap = a->capacidad ? a->capacidad * 2 : 4;
+        while (cap < minimo) cap *= 2;
+        bg_limb *nuevo = bg_arena_bloques(a->arena, cap);
+        if (a->capacidad)
+            memcpy(nuevo, a->bloques, a->capacidad * sizeof(bg_limb));
+        bg_arena_devolver(a->arena, a->bloques, a->capacidad);
+        a->bloques   = nuevo;
+        a->capacidad = cap;
+        return;
+    }
+    size_t cap = a->capacidad ? a->capacidad * 2 : 4;
+    if (cap < minimo) cap = minimo;
+    bg_limb *nuevo = realloc(a->bloques, cap * sizeof(bg_limb));
+    if (!nuevo) {
+        fprintf(stderr, "Error: no se pudo reservar memoria\n");
+        exit(1);
+    }
+    BG_CONTAR_RESERVA(cap * sizeof(bg_limb), a->capacidad * sizeof(bg_limb));
+    a->bloques   = nuevo;
+    a->capacidad = cap;
+}
+
+// Reserva capacidad para al menos n bloques sin cambiar el valor
+void bg_reservar(BigInt *a, size_t n) {
+    bg_crecer(a, n);
+}
+
+// Prepara 'destino' para recibir bloques desde cero; 'estimado' es la
+// longitud esperada del resultado y se reserva de una vez.
+void bg_constructor_iniciar(BgConstructor *c, BigInt *destino, size_t estimado) {
+    bg_crecer(destino, estimado);
+    destino->longitud = 0;
+    c->num = destino;
+    c->pos = 0;
+}
+
+// Agrega un bloque; solo realoja si se supera lo estimado
+static inline void bg_constructor_poner(BgConstructor *c, bg_limb v) {
+    if (c->pos == c->num->capacidad)
+        bg_crecer(c->num, c->pos + 1);
+    c->num->bloques[c->pos++] = v;
+}
+
+// Fija la longitud y quita ceros no significativos (el cero queda con un bloque)
+BigInt* bg_constructor_terminar(BgConstructor *c) {
+    BigInt *r = c->num;
+    size_t n = c->pos;
+    while (n > 1 && r->bloques[n-1] == 0) n--;
+    if (n == 0) {
+        bg_crecer(r, 1);
+        r->bloques[0] = 0;
+        n = 1;
+    }
+    r->longitud = n;
+    if (n == 1 && r->bloques[0] == 0) r->signo = +1;
+    return r;
+}
+
+// Inserta un bloque al inicio (más bajo peso)
+void bg_prepend(BigInt *a, bg_limb v) {
+    bg_crecer(a, a->longitud + 1);
+    memmove(a->bloques + 1, a->bloques, a->longitud * sizeof(bg_limb));
+    a->bloques[0] = v;
+    a->longitud++;
+}
+
+void bg_append(BigInt *a, bg_limb v) {
+    bg_crecer(a, a->longitud + 1);
+    a->bloques[a->longitud++] = v;
+}
+
+
+void printBigIntNodes(const BigInt *a) {
+    for (size_t i = 0; i < a->longitud; i++) {
+        printf("  Bloque %2zu: " BG_FMT_BLOQUE "\n", i, a->bloques[i]);
     }
+}
 
-    free(valores_a);
-    free(valores_b);
+static int compararMagnitud(const bg_limb *a, const bg_limb *b, size_t longitud) {
+    for (size_t i = longitud; i-- > 0; ) {
+        if (a[i] > b[i]) return 1;
+        if (a[i] < b[i]) return -1;
+    }
     return 0;
 }
 
@@ -163,423 +958,4660 @@ int compararBigInt(const BigInt *a, const BigInt *b) {
     if (a->longitud > b->longitud) return a->signo;
     if (a->longitud < b->longitud) return -a->signo;
 
-    int comparacion = compararMagnitud(a->cabeza, b->cabeza, a->longitud);
+    int comparacion = compararMagnitud(a->bloques, b->bloques, a->longitud);
     return a->signo < 0 ? -comparacion : comparacion;
 }
 
 
-// Función auxiliar para sumar magnitudes (sin considerar signos)
-static BigInt* sumarMagnitudes(const BigInt *a, const BigInt *b) {
-    BigInt *resultado = bg_nuevo();
-    const Nodo *pa = a->cabeza;
-    const Nodo *pb = b->cabeza;
-    uint64_t acarreo = 0;
+// ---------------------------------------------------------------------
+// Núcleo sobre bloques
+//
+// Las funciones mag_* operan sobre magnitudes sin signo dadas como
+// (puntero, longitud), con el bloque menos significativo primero. No
+// reservan memoria: el llamador entrega el destino y, si hace falta,
+// el espacio de trabajo. El destino puede coincidir exactamente con
+// una de las entradas salvo donde se indica lo contrario.
+// ---------------------------------------------------------------------
+
+// Longitud sin ceros no significativos (al menos 1)
+static size_t mag_normalizar(const bg_limb *a, size_t n) {
+    while (n > 1 && a[n-1] == 0) n--;
+    return n;
+}
+
+// Compara magnitudes de longitudes distintas
+static int mag_comparar(const bg_limb *a, size_t an, const bg_limb *b, size_t bn) {
+    an = mag_normalizar(a, an);
+    bn = mag_normalizar(b, bn);
+    if (an != bn) return an > bn ? 1 : -1;
+    return compararMagnitud(a, b, an);
+}
+
+// Suma de un bloque con acarreo: devuelve a + b + *c módulo la base
+static inline bg_limb bg_sumac(bg_limb a, bg_limb b, bg_limb *c) {
+#ifdef BG_DECIMAL
+    bg_limb s = a + b + *c;
+    *c = s >= DEC_BASE;
+    return *c ? s - DEC_BASE : s;
+#else
+    bg_dlimb s = (bg_dlimb)a + b + *c;
+    *c = BG_ALTO(s);
+    return BG_BAJO(s);
+#endif
+}
+
+// Resta de un bloque con préstamo: devuelve a - b - *p módulo la base
+static inline bg_limb bg_restac(bg_limb a, bg_limb b, bg_limb *p) {
+#ifdef BG_DECIMAL
+    bg_limb resta = b + *p;
+    *p = a < resta;
+    return *p ? a + (DEC_BASE - resta) : a - resta;
+#else
+    bg_dlimb d = (bg_dlimb)a - b - *p;
+    *p = BG_ALTO(d) & 1;
+    return BG_BAJO(d);
+#endif
+}
 
-    // Sumar mientras ambos nodos existan
-    while (pa && pb) {
-        uint64_t suma = (uint64_t)pa->valor + (uint64_t)pb->valor + acarreo;
-        bg_append(resultado, (uint32_t)(suma % DEC_BASE));
-        acarreo = suma / DEC_BASE;
-        pa = pa->sig;
-        pb = pb->sig;
+// r = a + b con an >= bn; r tiene an bloques y se devuelve el acarreo
+static bg_limb mag_sumar(bg_limb *r, const bg_limb *a, size_t an,
+                         const bg_limb *b, size_t bn) {
+    bg_limb acarreo = 0;
+    size_t i = 0;
+    BG_CONTAR(ops_bloque, an);
+    for (; i < bn; i++)
+        r[i] = bg_sumac(a[i], b[i], &acarreo);
+    for (; i < an && acarreo; i++) {
+        acarreo = a[i] == BG_MAX;
+        r[i] = acarreo ? 0 : a[i] + 1;
     }
+    if (r != a)
+        memcpy(r + i, a + i, (an - i) * sizeof(bg_limb));
+    return acarreo;
+}
 
-    // Procesar nodos restantes de a
-    while (pa) {
-        uint64_t suma = (uint64_t)pa->valor + acarreo;
-        bg_append(resultado, (uint32_t)(suma % DEC_BASE));
-        acarreo = suma / DEC_BASE;
-        pa = pa->sig;
+// r = a - b con an >= bn; r tiene an bloques y se devuelve el préstamo
+static bg_limb mag_restar(bg_limb *r, const bg_limb *a, size_t an,
+                          const bg_limb *b, size_t bn) {
+    bg_limb prestamo = 0;
+    size_t i = 0;
+    BG_CONTAR(ops_bloque, an);
+    for (; i < bn; i++)
+        r[i] = bg_restac(a[i], b[i], &prestamo);
+    for (; i < an && prestamo; i++) {
+        prestamo = a[i] == 0;
+        r[i] = prestamo ? BG_MAX : a[i] - 1;
     }
+    if (r != a)
+        memcpy(r + i, a + i, (an - i) * sizeof(bg_limb));
+    return prestamo;
+}
 
-    // Procesar nodos restantes de b
-    while (pb) {
-        uint64_t suma = (uint64_t)pb->valor + acarreo;
-        bg_append(resultado, (uint32_t)(suma % DEC_BASE));
-        acarreo = suma / DEC_BASE;
-        pb = pb->sig;
+// r = a * w; r tiene n bloques y se devuelve el bloque de acarreo
+static bg_limb mag_mul_1(bg_limb *r, const bg_limb *a, size_t n, bg_limb w) {
+    bg_limb acarreo = 0;
+    BG_CONTAR(ops_bloque, n);
+    for (size_t i = 0; i < n; i++) {
+        bg_dlimb producto = (bg_dlimb)a[i] * w + acarreo;
+        r[i] = BG_BAJO(producto);
+        acarreo = BG_ALTO(producto);
     }
+    return acarreo;
+}
 
-    // Agregar acarreo final si existe
-    if (acarreo > 0) {
-        bg_append(resultado, (uint32_t)acarreo);
+// r += a * w sobre n bloques; devuelve el acarreo para el bloque n
+static bg_limb mag_addmul_1(bg_limb *r, const bg_limb *a, size_t n, bg_limb w) {
+    bg_limb acarreo = 0;
+    BG_CONTAR(ops_bloque, n);
+    for (size_t i = 0; i < n; i++) {
+        bg_dlimb t = (bg_dlimb)a[i] * w + r[i] + acarreo;
+        r[i] = BG_BAJO(t);
+        acarreo = BG_ALTO(t);
     }
+    return acarreo;
+}
 
-    return resultado;
+// r -= a * w sobre n bloques; devuelve lo que falta restar en el bloque n
+static bg_limb mag_submul_1(bg_limb *r, const bg_limb *a, size_t n, bg_limb w) {
+    bg_limb acarreo = 0;
+    BG_CONTAR(ops_bloque, n);
+    for (size_t i = 0; i < n; i++) {
+        bg_dlimb producto = (bg_dlimb)a[i] * w + acarreo;
+        bg_limb bajo = BG_BAJO(producto);
+        bg_limb prestamo = 0;
+        acarreo = BG_ALTO(producto);
+        r[i] = bg_restac(r[i], bajo, &prestamo);
+        acarreo += prestamo;
+    }
+    return acarreo;
 }
 
+// q = a / d sobre n bloques (q puede ser a); devuelve el residuo
+static bg_limb mag_divrem_1(bg_limb *q, const bg_limb *a, size_t n, bg_limb d) {
+    bg_dlimb resto = 0;
+    BG_CONTAR(ops_bloque, n);
+    for (size_t i = n; i-- > 0; ) {
+        bg_dlimb t = BG_JUNTAR(resto, a[i]);
+        q[i] = (bg_limb)(t / d);
+        resto = t % d;
+    }
+    return (bg_limb)resto;
+}
 
-// Función auxiliar para restar magnitudes (a >= b en magnitud)
-static BigInt* restarMagnitudes(const BigInt *a, const BigInt *b) {
-    BigInt *resultado = bg_nuevo();
-    const Nodo *pa = a->cabeza;
-    const Nodo *pb = b->cabeza;
-    int64_t prestamo = 0;
-
-    // Restar mientras ambos nodos existan
-    while (pa && pb) {
-        int64_t resta = (int64_t)pa->valor - (int64_t)pb->valor - prestamo;
-        if (resta < 0) {
-            resta += DEC_BASE;
-            prestamo = 1;
-        } else {
-            prestamo = 0;
-        }
-        bg_append(resultado, (uint32_t)resta);
-        pa = pa->sig;
-        pb = pb->sig;
+// r = a / d para d = 2 o 3 cuando se sabe que la división es exacta
+// (interpolación de Toom). En las bases binarias evita dividir por
+// bloques: /2 es un desplazamiento y /3 multiplica por el inverso de 3
+// módulo la base, de abajo hacia arriba.
+static void mag_dividir_exacto(bg_limb *r, const bg_limb *a, size_t n, bg_limb d) {
+#ifdef BG_DECIMAL
+    mag_divrem_1(r, a, n, d);
+#else
+    if (d == 2) {
+        for (size_t i = 0; i + 1 < n; i++)
+            r[i] = (a[i] >> 1) | (a[i+1] << (BG_LIMB_BITS - 1));
+        r[n-1] = a[n-1] >> 1;
+        return;
     }
+    bg_limb inv = d;                        // d * d = 1 mod 8 para d impar
+    for (int i = 0; i < 5; i++) inv *= 2 - d * inv;
+    bg_limb c = 0;
+    for (size_t i = 0; i < n; i++) {
+        bg_limb s = a[i];
+        bg_limb prestamo = s < c;
+        bg_limb q = (s - c) * inv;
+        r[i] = q;
+        c = BG_ALTO((bg_dlimb)q * d) + prestamo;
+    }
+#endif
+}
 
-    // Procesar nodos restantes de a
-    while (pa) {
-        int64_t resta = (int64_t)pa->valor - prestamo;
-        if (resta < 0) {
-            resta += DEC_BASE;
-            prestamo = 1;
-        } else {
-            prestamo = 0;
-        }
-        bg_append(resultado, (uint32_t)resta);
-        pa = pa->sig;
+// Suma v al bloque 0 de r y propaga; devuelve el acarreo final
+static bg_limb mag_incrementar(bg_limb *r, size_t n, bg_limb v) {
+    for (size_t i = 0; i < n && v; i++) {
+        bg_limb acarreo = 0;
+        r[i] = bg_sumac(r[i], v, &acarreo);
+        v = acarreo;
     }
+    return v;
+}
 
-    return resultado;
+// r = BASE^n - r (complemento), para cuando una resta da negativo
+static void mag_complementar(bg_limb *r, size_t n) {
+    size_t i = 0;
+    while (i < n && r[i] == 0) i++;
+    if (i == n) return;
+    r[i] = BG_MAX - r[i] + 1;
+    for (i++; i < n; i++)
+        r[i] = BG_MAX - r[i];
 }
 
+#if BG_LIMB_BITS == 32
+// ---------------------------------------------------------------------
+// Caso base por columnas con acarreo diferido
+//
+// Con bloques de 32 bits cada producto cabe en 64 bits y sobra margen
+// para sumar muchos sin propagar acarreos. El producto escolar se arma
+// por ventanas de COL_ANCHO columnas con acumuladores de 64 bits: cada
+// fila de b suma a[i]*b[j] a las columnas de la ventana y el acarreo se
+// resuelve una sola vez por columna al cerrarla. La suma de una fila no
+// tiene dependencias entre columnas y, si el procesador los tiene, se
+// hace con AVX-512 o AVX2 (vpmuludq, 8 o 4 productos a la vez); se elige
+// al ejecutar, con el bucle escalar como respaldo.
+//
+// En base 10^9 un producto es < 10^18 y una columna admite COL_FILAS
+// filas antes de reducirla módulo la base. En base 2^32 cada producto se
+// parte en sus dos mitades, que van a acumuladores distintos (columna k
+// y k+1), y ninguno se desborda antes de 2^31 filas. En base 2^64 los
+// registros vectoriales no dan productos de 128 bits y el caso base se
+// queda con mag_addmul_1 por filas.
+// ---------------------------------------------------------------------
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(BG_SIN_SIMD)
+#define BG_SIMD
+#endif
+
+#define COL_ANCHO 256      // columnas por ventana
+#define COL_FILAS 16       // filas entre reducciones en base 10^9
+#define COL_MINIMO 144     // productos por debajo de los cuales van mejor las filas
+
+// lo[k] += a[k] * w para k < n; en base 2^32 la mitad alta va a hi[k]
+static void col_fila(uint64_t *lo, uint64_t *hi, const bg_limb *a, size_t n, bg_limb w) {
+    for (size_t k = 0; k < n; k++) {
+        uint64_t p = (uint64_t)a[k] * w;
+#ifdef BG_DECIMAL
+        (void)hi;
+        lo[k] += p;
+#else
+        lo[k] += (uint32_t)p;
+        hi[k] += p >> 32;
+#endif
+    }
+}
 
-// Función principal de suma
-BigInt* sumar(const BigInt *a, const BigInt *b) {
-    BigInt *resultado;
-
-    // Caso 1: Ambos números tienen el mismo signo
-    if (a->signo == b->signo) {
-        resultado = sumarMagnitudes(a, b);
-        resultado->signo = a->signo;
-    }
-    // Caso 2: Signos diferentes - efectivamente una resta
-    else {
-        // Comparar magnitudes para determinar el resultado
-        size_t max_len = a->longitud > b->longitud ? a->longitud : b->longitud;
-
-        // Expandir temporalmente las listas para comparar
-        int comparacion;
-        if (a->longitud > b->longitud) {
-            comparacion = 1;
-        } else if (a->longitud < b->longitud) {
-            comparacion = -1;
-        } else {
-            // Misma longitud, comparar nodo por nodo desde el más significativo
-            comparacion = compararMagnitud(a->cabeza, b->cabeza, max_len);
-        }
+#ifdef BG_SIMD
+__attribute__((target("avx2")))
+static void col_fila_avx2(uint64_t *lo, uint64_t *hi, const bg_limb *a, size_t n, bg_limb w) {
+    __m256i vw = _mm256_set1_epi64x(w);
+    size_t k = 0;
+    for (; k + 4 <= n; k += 4) {
+        __m256i p = _mm256_mul_epu32(_mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i *)(a + k))), vw);
+        __m256i l = _mm256_loadu_si256((const __m256i *)(lo + k));
+#ifdef BG_DECIMAL
+        _mm256_storeu_si256((__m256i *)(lo + k), _mm256_add_epi64(l, p));
+#else
+        __m256i h = _mm256_loadu_si256((const __m256i *)(hi + k));
+        __m256i bajo = _mm256_and_si256(p, _mm256_set1_epi64x(0xffffffff));
+        _mm256_storeu_si256((__m256i *)(lo + k), _mm256_add_epi64(l, bajo));
+        _mm256_storeu_si256((__m256i *)(hi + k), _mm256_add_epi64(h, _mm256_srli_epi64(p, 32)));
+#endif
+    }
+    col_fila(lo + k, hi + k, a + k, n - k, w);
+}
 
-        if (comparacion == 0) {
-            // |a| == |b|, resultado es cero
-            resultado = bg_nuevo();
-            bg_append(resultado, 0);
-        }
-        else if (comparacion > 0) {
-            // |a| > |b|
-            resultado = restarMagnitudes(a, b);
-            resultado->signo = a->signo;
+__attribute__((target("avx512f")))
+static void col_fila_avx512(uint64_t *lo, uint64_t *hi, const bg_limb *a, size_t n, bg_limb w) {
+    __m512i vw = _mm512_set1_epi64(w);
+    size_t k = 0;
+    for (; k + 8 <= n; k += 8) {
+        __m512i p = _mm512_mul_epu32(_mm512_cvtepu32_epi64(_mm256_loadu_si256((const __m256i *)(a + k))), vw);
+        __m512i l = _mm512_loadu_si512(lo + k);
+#ifdef BG_DECIMAL
+        _mm512_storeu_si512(lo + k, _mm512_add_epi64(l, p));
+#else
+        __m512i h = _mm512_loadu_si512(hi + k);
+        __m512i bajo = _mm512_and_si512(p, _mm512_set1_epi64(0xffffffff));
+        _mm512_storeu_si512(lo + k, _mm512_add_epi64(l, bajo));
+        _mm512_storeu_si512(hi + k, _mm512_add_epi64(h, _mm512_srli_epi64(p, 32)));
+#endif
+    }
+    col_fila(lo + k, hi + k, a + k, n - k, w);
+}
+#endif
+
+typedef void (*BgColFila)(uint64_t *, uint64_t *, const bg_limb *, size_t, bg_limb);
+
+static BgColFila col_elegir(void) {
+#ifdef BG_SIMD
+    if (__builtin_cpu_supports("avx512f")) return col_fila_avx512;
+    if (__builtin_cpu_supports("avx2"))    return col_fila_avx2;
+#endif
+    return col_fila;
+}
+
+#ifdef BG_DECIMAL
+// Deja lo[k] < BASE para k < w pasando lo que sobra a la columna siguiente
+static void col_reducir(uint64_t *lo, size_t w) {
+    for (size_t k = 0; k < w; k++) {
+        lo[k + 1] += lo[k] / DEC_BASE;
+        lo[k] %= DEC_BASE;
+    }
+}
+#endif
+
+// r (an+bn bloques, distinto de a y b) = a * b por columnas. Con
+// cuadrado (a y b el mismo operando) solo se suman los productos
+// cruzados i > j, que se duplican al cerrar cada columna junto con la
+// diagonal.
+static void mag_mul_columnas(bg_limb *r, const bg_limb *a, size_t an,
+                             const bg_limb *b, size_t bn, int cuadrado) {
+    BgColFila fila = col_elegir();
+    uint64_t lo[COL_ANCHO + 1], hi[COL_ANCHO];   // hi[k] va a la columna k+1
+    size_t rn = an + bn;
+    uint64_t acarreo = 0;
+
+    for (size_t c0 = 0; c0 < rn; c0 += COL_ANCHO) {
+        size_t w = rn - c0 < COL_ANCHO ? rn - c0 : COL_ANCHO;
+        memset(lo, 0, (w + 1) * sizeof(uint64_t));
+        memset(hi, 0, w * sizeof(uint64_t));
+
+        // Filas de b con alguna columna en [c0, c0 + w)
+        size_t j0 = c0 >= an ? c0 - an + 1 : 0;
+        size_t j1 = c0 + w < bn ? c0 + w : bn;
+        int filas = 0;
+        for (size_t j = j0; j < j1; j++) {
+            size_t i0 = c0 > j ? c0 - j : 0;
+            size_t i1 = c0 + w - j < an ? c0 + w - j : an;
+            if (cuadrado && i0 <= j) i0 = j + 1;
+            if (i0 >= i1) continue;
+            fila(lo + i0 + j - c0, hi + i0 + j - c0, a + i0, i1 - i0, b[j]);
+#ifdef BG_DECIMAL
+            if (++filas == COL_FILAS) {
+                col_reducir(lo, w);
+                filas = 0;
+            }
+#endif
         }
-        else {
-            // |a| < |b|
-            resultado = restarMagnitudes(b, a);
-            resultado->signo = b->signo;
+        (void)filas;
+#ifdef BG_DECIMAL
+        if (cuadrado) col_reducir(lo, w);   // margen para duplicar
+#endif
+
+        for (size_t k = 0; k < w; k++) {
+            size_t c = c0 + k;
+            uint64_t v = lo[k];
+#ifndef BG_DECIMAL
+            if (k > 0) v += hi[k - 1];
+#endif
+            if (cuadrado) {
+                uint64_t d = (uint64_t)a[c / 2] * a[c / 2];
+                v *= 2;
+#ifdef BG_DECIMAL
+                if (c % 2 == 0) v += d;
+#else
+                v += c % 2 == 0 ? (uint32_t)d : d >> 32;
+#endif
+            }
+            uint64_t t = v + acarreo;
+#ifdef BG_DECIMAL
+            r[c] = (bg_limb)(t % DEC_BASE);
+            acarreo = t / DEC_BASE;
+#else
+            r[c] = (bg_limb)t;
+            acarreo = t >> 32;
+#endif
         }
+        // Lo que pasa de la última columna de la ventana a la primera de la siguiente
+#ifdef BG_DECIMAL
+        acarreo += cuadrado ? 2 * lo[w] : lo[w];
+#else
+        acarreo += cuadrado ? 2 * hi[w - 1] : hi[w - 1];
+#endif
+    }
+}
+#endif /* BG_LIMB_BITS == 32 */
+
+// Multiplicación escolar: r (an+bn bloques, distinto de a y b) = a * b
+static void mag_mul_basecase(bg_limb *r, const bg_limb *a, size_t an,
+                             const bg_limb *b, size_t bn) {
+    BG_CONTAR_NIVEL(BG_NIVEL_ESCOLAR);
+#if BG_LIMB_BITS == 32
+    if (an * bn >= COL_MINIMO) {
+        BG_CONTAR(ops_bloque, an * bn);
+        mag_mul_columnas(r, a, an, b, bn, 0);
+        return;
     }
+#endif
+    r[an] = mag_mul_1(r, a, an, b[0]);
+    for (size_t j = 1; j < bn; j++)
+        r[an + j] = mag_addmul_1(r + j, a, an, b[j]);
+}
 
-    return resultado;
+// Cuadrado escolar: r (2n bloques, distinto de a) = a^2. Cada producto
+// cruzado a[i]*a[j] con i < j se calcula una sola vez, la suma se
+// duplica y después se añaden los cuadrados de la diagonal.
+static void mag_sqr_basecase(bg_limb *r, const bg_limb *a, size_t n) {
+    BG_CONTAR_NIVEL(BG_NIVEL_ESCOLAR_SQR);
+#if BG_LIMB_BITS == 32
+    if (n * n >= COL_MINIMO) {
+        BG_CONTAR(ops_bloque, n * (n + 1) / 2);
+        mag_mul_columnas(r, a, n, a, n, 1);
+        return;
+    }
+#endif
+    memset(r, 0, 2 * n * sizeof(bg_limb));
+    for (size_t i = 0; i + 1 < n; i++)
+        r[i + n] = mag_addmul_1(r + 2 * i + 1, a + i + 1, n - i - 1, a[i]);
+    mag_sumar(r, r, 2 * n, r, 2 * n);
+    bg_limb acarreo = 0;
+    for (size_t i = 0; i < n; i++) {
+        bg_dlimb c = (bg_dlimb)a[i] * a[i];
+        r[2 * i] = bg_sumac(r[2 * i], BG_BAJO(c), &acarreo);
+        r[2 * i + 1] = bg_sumac(r[2 * i + 1], BG_ALTO(c), &acarreo);
+    }
 }
 
-BigInt* multiplicar(const BigInt *a, const BigInt *b) {
-    BigInt *resultado = bg_nuevo();
-    bg_append(resultado, 0);
+// Umbrales de la multiplicación, en bloques del operando menor. Se
+// midieron con -O2 en cada base; pueden fijarse con -D al compilar.
+#if defined(BG_DECIMAL)
+#  define BG_KARATSUBA_MEDIDO     96
+#  define BG_KARATSUBA_SQR_MEDIDO 128
+#  define BG_TOOM3_MEDIDO         768
+#  define BG_NTT_MEDIDO           8192
+#elif BG_LIMB_BITS == 32
+#  define BG_KARATSUBA_MEDIDO     160
+#  define BG_KARATSUBA_SQR_MEDIDO 160
+#  define BG_TOOM3_MEDIDO         384
+#  define BG_NTT_MEDIDO           16384
+#else
+#  define BG_KARATSUBA_MEDIDO     28
+#  define BG_KARATSUBA_SQR_MEDIDO 40
+#  define BG_TOOM3_MEDIDO         192
+#  define BG_NTT_MEDIDO           2048
+#endif
+#ifndef KARATSUBA_UMBRAL
+#define KARATSUBA_UMBRAL BG_KARATSUBA_MEDIDO
+#endif
+#ifndef KARATSUBA_SQR_UMBRAL
+#define KARATSUBA_SQR_UMBRAL BG_KARATSUBA_SQR_MEDIDO
+#endif
+#ifndef TOOM3_UMBRAL
+#define TOOM3_UMBRAL BG_TOOM3_MEDIDO
+#endif
+
+// La NTT necesita productos de 128 bits; sin ellos el nivel más alto es Toom-3
+#if defined(__SIZEOF_INT128__) && !defined(BG_SIN_NTT)
+#define BG_NTT
+#endif
+#ifndef NTT_UMBRAL
+#define NTT_UMBRAL BG_NTT_MEDIDO
+#endif
+
+// Umbral de la división, en bloques del divisor: por debajo Knuth D; por
+// encima Newton, que cuesta unas pocas multiplicaciones de tamaño n por
+// cada n bloques de cociente. Medido con dividendos de 2n bloques; con
+// cocientes más largos Newton gana antes.
+#if defined(BG_DECIMAL)
+#  define BG_DIV_NEWTON_MEDIDO 192
+#elif BG_LIMB_BITS == 32
+#  define BG_DIV_NEWTON_MEDIDO 384
+#else
+#  define BG_DIV_NEWTON_MEDIDO 768
+#endif
+#ifndef DIV_NEWTON_UMBRAL
+#define DIV_NEWTON_UMBRAL BG_DIV_NEWTON_MEDIDO
+#endif
+
+// Bloques hasta los cuales la conversión decimal usa el método cuadrático
+#ifndef CONV_UMBRAL
+#define CONV_UMBRAL 32
+#endif
+
+// Umbrales en uso. Empiezan con los valores compilados y bg_perfil_cargar
+// los cambia por los que bg_afinar midió en la máquina que ejecuta. Los
+// hilos los leen sin sincronizar: solo deben cambiar con el grupo parado.
+typedef struct {
+    size_t karatsuba, karatsuba_sqr, toom3, ntt;
+    size_t div_newton;
+    size_t conv;
+} BgUmbrales;
+
+static BgUmbrales bg_umbral = {
+    KARATSUBA_UMBRAL, KARATSUBA_SQR_UMBRAL, TOOM3_UMBRAL, NTT_UMBRAL,
+    DIV_NEWTON_UMBRAL,
+    CONV_UMBRAL
+};
+
+// d = |a - b| sobre n bloques con bn <= n; devuelve +1 si a >= b, -1 si no
+static int mag_diferencia(bg_limb *d, const bg_limb *a, size_t n,
+                          const bg_limb *b, size_t bn) {
+    if (mag_comparar(a, n, b, bn) >= 0) {
+        mag_restar(d, a, n, b, bn);
+        return 1;
+    }
+    // b > a implica que los bloques de a por encima de bn son cero
+    mag_restar(d, b, bn, a, bn);
+    memset(d + bn, 0, (n - bn) * sizeof(bg_limb));
+    return -1;
+}
 
-    const Nodo *pb = b->cabeza;
-    int despl_b = 0;
+// r = sa*|a| + sb*|b| sobre n bloques con bn <= n; devuelve el signo.
+// El resultado debe caber en n bloques; r puede ser a o b.
+static int mag_sumar_signo(bg_limb *r, const bg_limb *a, size_t n, int sa,
+                           const bg_limb *b, size_t bn, int sb) {
+    if (sa == sb) {
+        mag_sumar(r, a, n, b, bn);
+        return sa;
+    }
+    return sa * mag_diferencia(r, a, n, b, bn);
+}
 
-    while (pb) {
-        const Nodo *pa = a->cabeza;
-        uint64_t acarreo = 0;
+static void mag_karatsuba(bg_limb *r, const bg_limb *a, size_t an,
+                          const bg_limb *b, size_t bn, bg_limb *tmp);
+static void mag_toom3(bg_limb *r, const bg_limb *a, size_t an,
+                      const bg_limb *b, size_t bn, bg_limb *tmp);
+static void mag_toom32(bg_limb *r, const bg_limb *a, size_t an,
+                       const bg_limb *b, size_t bn, bg_limb *tmp);
+static void mag_mul_troceado(bg_limb *r, const bg_limb *a, size_t an,
+                             const bg_limb *b, size_t bn, bg_limb *tmp);
+static void mag_sqr(bg_limb *r, const bg_limb *a, size_t n, bg_limb *tmp);
+static void mag_mul(bg_limb *r, const bg_limb *a, size_t an,
+                    const bg_limb *b, size_t bn, bg_limb *tmp);
+#ifdef BG_NTT
+static size_t mag_ntt_espacio(size_t an, size_t bn);
+static void mag_ntt(bg_limb *r, const bg_limb *a, size_t an,
+                    const bg_limb *b, size_t bn, bg_limb *tmp);
+#endif
+static void mag_multiplicar(bg_limb *r, const bg_limb *a, size_t an,
+                            const bg_limb *b, size_t bn);
+
+// Subproducto de Karatsuba o Toom que se ofrece al grupo de hilos. La
+// tarea no comparte el espacio de trabajo del nivel que la lanza: pide el
+// suyo a la arena temporal del hilo que la ejecuta.
+typedef struct {
+    BgTarea tarea;
+    bg_limb *r;
+    const bg_limb *a, *b;
+    size_t an, bn;
+} BgTareaMul;
+
+static void mag_mul_tarea(BgTarea *tarea) {
+    BgTareaMul *t = (BgTareaMul *)tarea;
+    BgArena *previa = bg_temporal_abrir();
+    mag_multiplicar(t->r, t->a, t->an, t->b, t->bn);
+    bg_temporal_cerrar(previa);
+}
 
-        BigInt *parcial = bg_nuevo();
+// r = a * b como tarea si paralelo, o ya mismo con tmp si no
+static void mag_mul_repartir(BgTareaMul *t, int paralelo, bg_limb *r,
+                             const bg_limb *a, size_t an,
+                             const bg_limb *b, size_t bn, bg_limb *tmp) {
+    if (!paralelo) {
+        mag_mul(r, a, an, b, bn, tmp);
+        return;
+    }
+    t->tarea.fn = mag_mul_tarea;
+    t->r = r;
+    t->a = a; t->an = an;
+    t->b = b; t->bn = bn;
+    bg_tarea_lanzar(&t->tarea);
+}
 
-        for (int i = 0; i < despl_b; i++) {
-            bg_append(parcial, 0);
-        }
+static void mag_mul_recoger(BgTareaMul *t, int paralelo) {
+    if (paralelo) bg_tarea_esperar(&t->tarea);
+}
 
-        while (pa) {
-            uint64_t producto = (uint64_t)pa->valor * (uint64_t)pb->valor + acarreo;
-            bg_append(parcial, (uint32_t)(producto % DEC_BASE));
-            acarreo = producto / DEC_BASE;
-            pa = pa->sig;
-        }
+// Toom-3 parte en tercios de ceil(an/3) bloques y necesita que b llegue
+// al tercio alto; si no, Karatsuba reparte mejor el trabajo
+static int mag_usar_toom3(size_t an, size_t bn) {
+    return bn >= bg_umbral.toom3 && bn > 2 * ((an + 2) / 3);
+}
+
+// Operandos dispares (an >= bn) por debajo del umbral de la NTT; por encima una
+// sola NTT de an+bn sale más barata que transformar b en cada trozo.
+// Desde an >= 2bn se trocea a en bloques de bn; entre 3:2 y 2:1, donde
+// Karatsuba dejaría una mitad de b casi vacía y Toom-3 no llega al tercio
+// alto, se usa Toom-(3,2).
+static int mag_usar_troceo(size_t an, size_t bn) {
+    return an >= 2 * bn;
+}
+
+static int mag_usar_toom32(size_t an, size_t bn) {
+    size_t k = (an + 2) / 3;
+    return bn <= 2 * k && an > 2 * k;
+}
+
+static size_t mag_mul_espacio(size_t an, size_t bn);
+
+// Toom-3 y NTT elevan al cuadrado con el mismo esquema que multiplican
+static int mag_sqr_como_mul(size_t n) {
+#ifdef BG_NTT
+    if (n >= bg_umbral.ntt) return 1;
+#endif
+    return mag_usar_toom3(n, n);
+}
 
-        if (acarreo > 0)
-            bg_append(parcial, (uint32_t)acarreo);
+// Espacio de trabajo que necesita mag_sqr(n)
+static size_t mag_sqr_espacio(size_t n) {
+    if (n < bg_umbral.karatsuba_sqr) return 0;
+    if (mag_sqr_como_mul(n)) return mag_mul_espacio(n, n);
+    size_t m = (n + 1) / 2;
+    size_t e0 = mag_sqr_espacio(m), e2 = mag_sqr_espacio(n - m);
+    return 5 * m + 1 + (e0 > e2 ? e0 : e2);
+}
 
-        BigInt *nuevo_res = sumar(resultado, parcial);
-        bg_liberar(resultado);
-        bg_liberar(parcial);
-        resultado = nuevo_res;
+// Espacio de trabajo que necesita mag_mul(an, bn)
+static size_t mag_mul_espacio(size_t an, size_t bn) {
+    if (an < bn) { size_t t = an; an = bn; bn = t; }
+    // Con an == bn mag_mul puede recibir el mismo operando dos veces e
+    // ir por mag_sqr, que por debajo de Toom-3 usa su propio esquema
+    size_t e_sqr = an == bn && !mag_sqr_como_mul(an) ? mag_sqr_espacio(an) : 0;
+    if (bn < bg_umbral.karatsuba) return e_sqr;
+#ifdef BG_NTT
+    if (bn >= bg_umbral.ntt) return mag_ntt_espacio(an, bn);
+#endif
+    if (mag_usar_troceo(an, bn)) {
+        size_t resto = an % bn;
+        size_t e = mag_mul_espacio(bn, bn);
+        size_t e1 = resto ? mag_mul_espacio(bn, resto) : 0;
+        return 2 * bn + (e > e1 ? e : e1);
+    }
+    if (mag_usar_toom3(an, bn)) {
+        // El espacio no es monótono cerca de los umbrales: se cubre
+        // cada uno de los productos que hace mag_toom3
+        size_t k = (an + 2) / 3;
+        size_t e = mag_mul_espacio(k + 1, k + 1);
+        size_t e0 = mag_mul_espacio(k, k);
+        size_t e4 = mag_mul_espacio(an - 2 * k, bn - 2 * k);
+        if (e0 > e) e = e0;
+        if (e4 > e) e = e4;
+        return 12 * (k + 1) + e;
+    }
+    if (mag_usar_toom32(an, bn)) {
+        size_t k = (an + 2) / 3;
+        size_t e = mag_mul_espacio(k + 1, k + 1);
+        size_t e0 = mag_mul_espacio(k, k);
+        size_t e3 = mag_mul_espacio(an - 2 * k, bn - k);
+        if (e0 > e) e = e0;
+        if (e3 > e) e = e3;
+        return 10 * (k + 1) + e;
+    }
+    size_t m = (an + 1) / 2;
+    size_t e0 = mag_mul_espacio(m, m);
+    size_t e2 = mag_mul_espacio(an - m, bn - m);
+    size_t e = 6 * m + 1 + (e0 > e2 ? e0 : e2);
+    return e > e_sqr ? e : e_sqr;
+}
 
-        pb = pb->sig;
-        despl_b++;
+// r (an+bn bloques) = a * b para cualquier orden de los operandos.
+// Elige escolar, Karatsuba, Toom-3 o NTT según el tamaño del menor, y
+// troceo o Toom-(3,2) según la razón de tamaños; si a y b son el mismo
+// operando pasa a mag_sqr.
+static void mag_mul(bg_limb *r, const bg_limb *a, size_t an,
+                    const bg_limb *b, size_t bn, bg_limb *tmp) {
+    if (a == b && an == bn) {
+        mag_sqr(r, a, an, tmp);
+        return;
     }
+    if (an < bn) {
+        const bg_limb *t = a; a = b; b = t;
+        size_t tn = an; an = bn; bn = tn;
+    }
+    BG_RECURSION_ENTRAR();
+    if (bn < bg_umbral.karatsuba)     mag_mul_basecase(r, a, an, b, bn);
+#ifdef BG_NTT
+    else if (bn >= bg_umbral.ntt)     mag_ntt(r, a, an, b, bn, tmp);
+#endif
+    else if (mag_usar_troceo(an, bn)) mag_mul_troceado(r, a, an, b, bn, tmp);
+    else if (mag_usar_toom3(an, bn))  mag_toom3(r, a, an, b, bn, tmp);
+    else if (mag_usar_toom32(an, bn)) mag_toom32(r, a, an, b, bn, tmp);
+    else                              mag_karatsuba(r, a, an, b, bn, tmp);
+    BG_RECURSION_SALIR();
+}
 
-    resultado->signo = a->signo * b->signo;
-    return resultado;
+// Karatsuba sobre bloques: r (an+bn bloques, distinto de a y b) = a * b
+// con an >= bn > ceil(an/2). Con m = ceil(an/2), z0 = aL*bL va directo a r[0..2m) y
+// z2 = aH*bH a r[2m..). El término medio se obtiene de la variante con
+// restas, z1 = z0 + z2 - (aL-aH)(bL-bH), para que las mitades no crezcan
+// un bloque por el acarreo; se arma en tmp y se suma en r[m..).
+static void mag_karatsuba(bg_limb *r, const bg_limb *a, size_t an,
+                          const bg_limb *b, size_t bn, bg_limb *tmp) {
+    BG_CONTAR_NIVEL(BG_NIVEL_KARATSUBA);
+    size_t m = (an + 1) / 2;
+    size_t ha = an - m;
+    size_t hb = bn - m;
+    bg_limb *da = tmp;
+    bg_limb *db = da + m;
+    bg_limb *p  = db + m;
+    bg_limb *t  = p + 2 * m;
+    bg_limb *resto_tmp = t + 2 * m + 1;
+
+    int sa = mag_diferencia(da, a, m, a + m, ha);
+    int sb = mag_diferencia(db, b, m, b + m, hb);
+
+    // Con hilos z2 y el producto de las diferencias van como tareas
+    int par = bg_en_paralelo(bn);
+    BgTareaMul tareas[2];
+    mag_mul_repartir(&tareas[0], par, r + 2 * m, a + m, ha, b + m, hb, resto_tmp); // z2
+    mag_mul_repartir(&tareas[1], par, p, da, m, db, m, resto_tmp);  // |aL-aH||bL-bH|
+    mag_mul(r, a, m, b, m, resto_tmp);                              // z0
+    mag_mul_recoger(&tareas[1], par);
+    mag_mul_recoger(&tareas[0], par);
+
+    // t = z0 + z2 -/+ p
+    t[2 * m] = mag_sumar(t, r, 2 * m, r + 2 * m, ha + hb);
+    if (sa == sb)
+        mag_restar(t, t, 2 * m + 1, p, 2 * m);
+    else
+        mag_sumar(t, t, 2 * m + 1, p, 2 * m);
+    size_t tn = mag_normalizar(t, 2 * m + 1);
+
+    mag_sumar(r + m, r + m, an + bn - m, t, tn);
 }
 
 
-//Clona un BigInt completo:
-BigInt* bg_clone(const BigInt *a) {
-    BigInt *r = bg_nuevo();
-    r->signo = a->signo;
-    for (Nodo *p = a->cabeza; p; p = p->sig)
-        bg_append(r, p->valor);
-    return r;
+// Evalúa x = x0 + x1*X + x2*X^2 (tercios de k bloques, x2 de n2) en
+// X = 1, -1 y 2 (este último solo si e2 no es NULL). Cada valor ocupa k+1
+// bloques; devuelve el signo de x(-1).
+static int mag_toom3_evaluar(bg_limb *e1, bg_limb *em1, bg_limb *e2,
+                             const bg_limb *x, size_t k, size_t n2) {
+    const bg_limb *x0 = x, *x1 = x + k, *x2 = x + 2 * k;
+
+    e1[k] = mag_sumar(e1, x0, k, x2, n2);                // x0 + x2
+    int s = mag_diferencia(em1, e1, k + 1, x1, k);       // x(-1)
+    mag_sumar(e1, e1, k + 1, x1, k);                     // x(1)
+    if (e2 == NULL) return s;
+
+    memcpy(e2, x0, k * sizeof(bg_limb));                 // x(2) = x0 + 2x1 + 4x2
+    e2[k] = mag_addmul_1(e2, x1, k, 2);
+    bg_limb c = mag_addmul_1(e2, x2, n2, 4);
+    mag_incrementar(e2 + n2, k + 1 - n2, c);
+    return s;
 }
 
-//Desplaza un BigInt por 'bloques' posiciones (multiplica por DEC_BASE^bloques):
-BigInt* bg_shift(const BigInt *a, size_t bloques) {
-    BigInt *r = bg_clone(a);
-    for (size_t i = 0; i < bloques; i++)
-        bg_prepend(r, 0);
-    return r;
+// Toom-3 sobre bloques: r (an+bn bloques, distinto de a y b) = a * b con
+// an >= bn > 2k, k = ceil(an/3). Se evalúa en 0, 1, -1, 2 e infinito y
+// se interpola con una secuencia que solo divide de forma exacta entre
+// 2 y 3. v0 y vinf van directo a su sitio en r.
+static void mag_toom3(bg_limb *r, const bg_limb *a, size_t an,
+                      const bg_limb *b, size_t bn, bg_limb *tmp) {
+    BG_CONTAR_NIVEL(BG_NIVEL_TOOM3);
+    size_t k = (an + 2) / 3;
+    size_t a2n = an - 2 * k, b2n = bn - 2 * k;
+    size_t l = 2 * k + 2;                                // bloques de v1, vm1, v2
+
+    bg_limb *ea1 = tmp,       *eam1 = ea1 + k + 1, *ea2 = eam1 + k + 1;
+    bg_limb *eb1 = ea2 + k + 1, *ebm1 = eb1 + k + 1, *eb2 = ebm1 + k + 1;
+    bg_limb *v1 = eb2 + k + 1, *vm1 = v1 + l, *v2 = vm1 + l;
+    bg_limb *resto_tmp = v2 + l;
+
+    int sa = mag_toom3_evaluar(ea1, eam1, ea2, a, k, a2n);
+    int sb = sa;
+    if (a == b) {
+        // Cuadrado: los productos de abajo reciben dos veces el mismo
+        // operando y mag_mul los eleva al cuadrado
+        eb1 = ea1; ebm1 = eam1; eb2 = ea2;
+    } else {
+        sb = mag_toom3_evaluar(eb1, ebm1, eb2, b, k, b2n);
+    }
+
+    // Con hilos todos menos v0 van como tareas
+    int par = bg_en_paralelo(bn);
+    BgTareaMul tareas[4];
+    memset(r + 2 * k, 0, 2 * k * sizeof(bg_limb));
+    mag_mul_repartir(&tareas[0], par, r + 4 * k, a + 2 * k, a2n, b + 2 * k, b2n, resto_tmp); // vinf
+    mag_mul_repartir(&tareas[1], par, v1, ea1, k + 1, eb1, k + 1, resto_tmp);
+    mag_mul_repartir(&tareas[2], par, vm1, eam1, k + 1, ebm1, k + 1, resto_tmp);
+    mag_mul_repartir(&tareas[3], par, v2, ea2, k + 1, eb2, k + 1, resto_tmp);
+    mag_mul(r, a, k, b, k, resto_tmp);                             // v0
+    for (int i = 3; i >= 0; i--) mag_mul_recoger(&tareas[i], par);
+    int sm1 = sa * sb;
+
+    const bg_limb *v0 = r, *vinf = r + 4 * k;
+    size_t infn = a2n + b2n;
+
+    // Tras la interpolación v1 = c2, vm1 = c1 y v2 = c3. Solo vm1 entra
+    // con signo; todos los valores intermedios son >= 0.
+    mag_sumar_signo(v2, v2, l, 1, vm1, l, -sm1);          // (v2 - vm1) / 3
+    mag_dividir_exacto(v2, v2, l, 3);
+    mag_sumar_signo(vm1, v1, l, 1, vm1, l, -sm1);         // c1 + c3
+    mag_dividir_exacto(vm1, vm1, l, 2);
+    mag_restar(v1, v1, l, v0, 2 * k);                     // c1 + c2 + c3 + c4
+    mag_restar(v2, v2, l, v1, l);                         // c3 + 2*c4
+    mag_dividir_exacto(v2, v2, l, 2);
+    mag_restar(v1, v1, l, vm1, l);                        // c2 + c4
+    mag_restar(v1, v1, l, vinf, infn);                    // c2
+    mag_restar(v2, v2, l, vinf, infn);
+    mag_restar(v2, v2, l, vinf, infn);                    // c3
+    mag_restar(vm1, vm1, l, v2, l);                       // c1
+
+    // r += c1*X + c2*X^2 + c3*X^3 con X = BASE^k
+    size_t rn = an + bn;
+    mag_sumar(r + k, r + k, rn - k, vm1, mag_normalizar(vm1, l));
+    mag_sumar(r + 2 * k, r + 2 * k, rn - 2 * k, v1, mag_normalizar(v1, l));
+    mag_sumar(r + 3 * k, r + 3 * k, rn - 3 * k, v2, mag_normalizar(v2, l));
 }
 
-//Suma dos BigInt asumiendo magnitud:
-BigInt* bg_sumar_magnitud(const BigInt *a, const BigInt *b) {
-    // Crear copias temporales con signo positivo
-    BigInt *temp_a = bg_clone(a);
-    BigInt *temp_b = bg_clone(b);
-    temp_a->signo = 1;
-    temp_b->signo = 1;
+// Toom-(3,2) sobre bloques: r (an+bn bloques, distinto de a y b) = a * b
+// con a en tercios y b en mitades de k = ceil(an/3) bloques, para
+// k < bn <= 2k. El producto tiene grado 3 y basta evaluar en 0, 1, -1 e
+// infinito: c2 = (v1 + vm1)/2 - v0 y c1 = (v1 - vm1)/2 - vinf.
+static void mag_toom32(bg_limb *r, const bg_limb *a, size_t an,
+                       const bg_limb *b, size_t bn, bg_limb *tmp) {
+    BG_CONTAR_NIVEL(BG_NIVEL_TOOM32);
+    size_t k = (an + 2) / 3;
+    size_t a2n = an - 2 * k, b1n = bn - k;
+    size_t l = 2 * k + 2;                                // bloques de v1, vm1, d
+
+    bg_limb *ea1 = tmp, *eam1 = ea1 + k + 1;
+    bg_limb *eb1 = eam1 + k + 1, *ebm1 = eb1 + k + 1;
+    bg_limb *v1 = ebm1 + k + 1, *vm1 = v1 + l, *d = vm1 + l;
+    bg_limb *resto_tmp = d + l;
+
+    int sa = mag_toom3_evaluar(ea1, eam1, NULL, a, k, a2n);
+    eb1[k] = mag_sumar(eb1, b, k, b + k, b1n);
+    int sb = mag_diferencia(ebm1, b, k, b + k, b1n);
+    ebm1[k] = 0;
+
+    int par = bg_en_paralelo(bn);
+    BgTareaMul tareas[3];
+    memset(r + 2 * k, 0, k * sizeof(bg_limb));
+    mag_mul_repartir(&tareas[0], par, r + 3 * k, a + 2 * k, a2n, b + k, b1n, resto_tmp); // vinf
+    mag_mul_repartir(&tareas[1], par, v1, ea1, k + 1, eb1, k + 1, resto_tmp);
+    mag_mul_repartir(&tareas[2], par, vm1, eam1, k + 1, ebm1, k + 1, resto_tmp);
+    mag_mul(r, a, k, b, k, resto_tmp);                             // v0
+    for (int i = 2; i >= 0; i--) mag_mul_recoger(&tareas[i], par);
+    int sm1 = sa * sb;
+
+    // d = c1 + c3 y v1 = c0 + c2, ambos >= 0
+    mag_sumar_signo(d, v1, l, 1, vm1, l, -sm1);
+    mag_dividir_exacto(d, d, l, 2);
+    mag_sumar_signo(v1, v1, l, 1, vm1, l, sm1);
+    mag_dividir_exacto(v1, v1, l, 2);
+    mag_restar(v1, v1, l, r, 2 * k);                               // c2
+    mag_restar(d, d, l, r + 3 * k, a2n + b1n);                     // c1
+
+    // r += c1*X + c2*X^2 con X = BASE^k
+    size_t rn = an + bn;
+    mag_sumar(r + k, r + k, rn - k, d, mag_normalizar(d, l));
+    mag_sumar(r + 2 * k, r + 2 * k, rn - 2 * k, v1, mag_normalizar(v1, l));
+}
 
-    BigInt *resultado = sumar(temp_a, temp_b);
+// Troceo para an >= 2bn: r (an+bn bloques, distinto de a y b) = a * b
+// multiplicando b por trozos de a de bn bloques, cada uno un producto
+// equilibrado, y acumulando cada trozo en r a su desplazamiento.
+static void mag_mul_troceado(bg_limb *r, const bg_limb *a, size_t an,
+                             const bg_limb *b, size_t bn, bg_limb *tmp) {
+    BG_CONTAR_NIVEL(BG_NIVEL_TROCEO);
+    bg_limb *p = tmp;                                    // 2bn bloques
+    bg_limb *resto_tmp = p + 2 * bn;
+
+    mag_mul(r, a, bn, b, bn, resto_tmp);
+    for (size_t i = bn; i < an; i += bn) {
+        size_t n = an - i < bn ? an - i : bn;
+        // r[i..i+bn) ya tiene la parte alta del trozo anterior
+        mag_mul(p, a + i, n, b, bn, resto_tmp);
+        memcpy(r + i + bn, p + bn, n * sizeof(bg_limb));
+        bg_limb acarreo = mag_sumar(r + i, r + i, bn, p, bn);
+        mag_incrementar(r + i + bn, n, acarreo);
+    }
+}
 
-    bg_liberar(temp_a);
-    bg_liberar(temp_b);
-    return resultado;
+
+#ifdef BG_NTT
+// ---------------------------------------------------------------------
+// Multiplicación por transformada (NTT)
+//
+// Por encima de su umbral cada bloque es un coeficiente y el producto es
+// una convolución, que se calcula con transformadas de tamaño potencia
+// de dos módulo tres primos p = c*2^k + 1 menores que 2^62. Cada
+// coeficiente de la convolución es menor que N * BASE^2 < p1*p2*p3, así
+// que el teorema chino del resto (forma de Garner) lo reconstruye
+// exacto y después se propagan los acarreos en la base de los bloques.
+// La reducción modular usa la forma de Montgomery con R = 2^64.
+// ---------------------------------------------------------------------
+
+typedef unsigned __int128 bg_u128;
+
+typedef struct {
+    uint64_t p;
+    uint64_t pinv;      // -p^-1 mod 2^64
+    uint64_t r2;        // R^2 mod p
+    uint64_t uno;       // R mod p, el 1 en forma de Montgomery
+} BgPrimoNTT;
+
+// Primos en orden creciente, con p - 1 divisible por 2^41, y una raíz primitiva de cada uno
+static const uint64_t bg_ntt_primos[3] = {
+    4611549678985543681ULL, 4611613450659954689ULL, 4611615649683210241ULL
+};
+static const uint64_t bg_ntt_raices[3] = { 19, 3, 11 };
+
+static void ntt_preparar(BgPrimoNTT *m, uint64_t p) {
+    m->p = p;
+    uint64_t inv = p;                       // p * p = 1 mod 8 para p impar
+    for (int i = 0; i < 5; i++) inv *= 2 - p * inv;
+    m->pinv = -inv;
+    m->uno = (uint64_t)(((bg_u128)1 << 64) % p);
+    m->r2 = (uint64_t)((bg_u128)m->uno * m->uno % p);
 }
 
-//Resta b de a, asumiendo a >= b en magnitud:
-BigInt* bg_restar_magnitud(const BigInt *a, const BigInt *b) {
-    // Crear copias temporales
-    BigInt *temp_a = bg_clone(a);
-    BigInt *temp_b = bg_clone(b);
-    temp_a->signo = 1;
-    temp_b->signo = -1;  // Hacer b negativo para que suma haga resta
+// a * b * R^-1 mod p, para a < 2^64 y b < p
+static inline uint64_t ntt_mul(uint64_t a, uint64_t b, const BgPrimoNTT *m) {
+    bg_u128 t = (bg_u128)a * b;
+    uint64_t q = (uint64_t)t * m->pinv;
+    uint64_t u = (uint64_t)((t + (bg_u128)q * m->p) >> 64);
+    return u >= m->p ? u - m->p : u;
+}
 
-    BigInt *resultado = sumar(temp_a, temp_b);
+static inline uint64_t ntt_sumar(uint64_t a, uint64_t b, uint64_t p) {
+    uint64_t s = a + b;
+    return s >= p ? s - p : s;
+}
 
-    bg_liberar(temp_a);
-    bg_liberar(temp_b);
-    return resultado;
+static inline uint64_t ntt_restar(uint64_t a, uint64_t b, uint64_t p) {
+    return a >= b ? a - b : a + p - b;
 }
 
-// Función para dividir un BigInt en dos partes
-void bg_split(const BigInt *orig, size_t m, BigInt **pLow, BigInt **pHigh) {
-    *pLow  = bg_nuevo();
-    *pHigh = bg_nuevo();
-    (*pLow)->signo  = orig->signo;
-    (*pHigh)->signo = orig->signo;
+// x^e con x y el resultado en forma de Montgomery
+static uint64_t ntt_potencia(uint64_t x, uint64_t e, const BgPrimoNTT *m) {
+    uint64_t r = m->uno;
+    for (; e; e >>= 1) {
+        if (e & 1) r = ntt_mul(r, x, m);
+        x = ntt_mul(x, x, m);
+    }
+    return r;
+}
+
+// w[h + j] = w_2h^j para h = 1, 2, ..., n/2 y j < h, en forma de Montgomery.
+// El nivel alto se calcula y los demás se toman de él cada dos.
+static void ntt_raices(uint64_t *w, size_t n, uint64_t g, const BgPrimoNTT *m) {
+    size_t h = n / 2;
+    uint64_t wn = ntt_potencia(ntt_mul(g, m->r2, m), (m->p - 1) / n, m);
+    w[h] = m->uno;
+    for (size_t j = 1; j < h; j++)
+        w[h + j] = ntt_mul(w[h + j - 1], wn, m);
+    for (h /= 2; h >= 1; h /= 2)
+        for (size_t j = 0; j < h; j++)
+            w[h + j] = w[2 * h + 2 * j];
+}
 
-    Nodo *p = orig->cabeza;
-    size_t idx = 0;
-    while (p) {
-        if (idx < m)
-            bg_append(*pLow, p->valor);
-        else
-            bg_append(*pHigh, p->valor);
-        p = p->sig;
-        idx++;
+#define NTT_BLOQUE 4096   // coeficientes que se transforman de una vez en caché
+#ifndef NTT_PARALELO
+#define NTT_PARALELO (1 << 16)   // desde aquí, con hilos, una mitad va como tarea
+#endif
+
+static void ntt_directa(uint64_t *a, size_t n, const uint64_t *w, const BgPrimoNTT *m);
+static void ntt_inversa(uint64_t *a, size_t n, const uint64_t *w, const BgPrimoNTT *m);
+
+typedef struct {
+    BgTarea tarea;
+    uint64_t *a;
+    size_t n;
+    const uint64_t *w;
+    const BgPrimoNTT *m;
+} BgTareaNTT;
+
+static void ntt_directa_tarea(BgTarea *tarea) {
+    BgTareaNTT *t = (BgTareaNTT *)tarea;
+    ntt_directa(t->a, t->n, t->w, t->m);
+}
+
+static void ntt_inversa_tarea(BgTarea *tarea) {
+    BgTareaNTT *t = (BgTareaNTT *)tarea;
+    ntt_inversa(t->a, t->n, t->w, t->m);
+}
+
+// Transforma las dos mitades de a, la alta como tarea si compensa
+static void ntt_mitades(void (*fn)(BgTarea *), uint64_t *a, size_t n,
+                        const uint64_t *w, const BgPrimoNTT *m) {
+    BgTareaNTT alta = { .tarea.fn = fn, .a = a + n / 2, .n = n / 2, .w = w, .m = m };
+    BgTareaNTT baja = { .tarea.fn = fn, .a = a, .n = n / 2, .w = w, .m = m };
+    if (bg_hilos() > 1 && n >= NTT_PARALELO) {
+        bg_tarea_lanzar(&alta.tarea);
+        fn(&baja.tarea);
+        bg_tarea_esperar(&alta.tarea);
+    } else {
+        fn(&baja.tarea);
+        fn(&alta.tarea);
+    }
+}
+
+// Transformada directa (Gentleman-Sande): orden natural -> bits invertidos.
+// Tras la primera etapa las dos mitades son transformadas independientes,
+// así que por encima de NTT_BLOQUE se recurre y cada mitad cabe en caché.
+static void ntt_directa(uint64_t *a, size_t n, const uint64_t *w, const BgPrimoNTT *m) {
+    uint64_t p = m->p;
+    size_t tope = n > NTT_BLOQUE ? n / 2 : 1;
+    for (size_t h = n / 2; h >= tope; h /= 2) {
+        BG_CONTAR(ops_bloque, n / 2);                    // mariposas de la etapa
+        for (size_t s = 0; s < n; s += 2 * h)
+            for (size_t j = 0; j < h; j++) {
+                uint64_t u = a[s + j], v = a[s + j + h];
+                a[s + j] = ntt_sumar(u, v, p);
+                a[s + j + h] = ntt_mul(ntt_restar(u, v, p), w[h + j], m);
+            }
+    }
+    if (n > NTT_BLOQUE) ntt_mitades(ntt_directa_tarea, a, n, w, m);
+}
+
+// Transformada inversa sin escalar (Cooley-Tukey): bits invertidos ->
+// orden natural. Usa w_2h^-j = -w_2h^(h-j) = -w[2h - j].
+static void ntt_inversa(uint64_t *a, size_t n, const uint64_t *w, const BgPrimoNTT *m) {
+    uint64_t p = m->p;
+    size_t desde = 1;
+    if (n > NTT_BLOQUE) {
+        ntt_mitades(ntt_inversa_tarea, a, n, w, m);
+        desde = n / 2;
+    }
+    for (size_t h = desde; h < n; h *= 2) {
+        BG_CONTAR(ops_bloque, n / 2);
+        for (size_t s = 0; s < n; s += 2 * h) {
+            uint64_t u = a[s], v = a[s + h];
+            a[s] = ntt_sumar(u, v, p);
+            a[s + h] = ntt_restar(u, v, p);
+            for (size_t j = 1; j < h; j++) {
+                u = a[s + j];
+                uint64_t t = ntt_mul(a[s + j + h], w[2 * h - j], m);
+                a[s + j] = ntt_restar(u, t, p);
+                a[s + j + h] = ntt_sumar(u, t, p);
+            }
+        }
+    }
+}
+
+static size_t ntt_tamano(size_t an, size_t bn) {
+    size_t n = 2;
+    while (n < an + bn - 1) n *= 2;
+    return n;
+}
+
+// Espacio de trabajo de mag_ntt en bloques: raíces, dos transformadas y
+// dos restos de an+bn-1 coeficientes, más uno para alinear a 64 bits
+static size_t mag_ntt_espacio(size_t an, size_t bn) {
+    size_t n = ntt_tamano(an, bn);
+    size_t palabras = 3 * n + 2 * (an + bn - 1);
+    return palabras * (sizeof(uint64_t) / sizeof(bg_limb)) + 1;
+}
+
+// Convolución de a y b módulo m en fa (n coeficientes, orden natural)
+static void ntt_convolucion(uint64_t *fa, uint64_t *fb, uint64_t *w, size_t n,
+                            const bg_limb *a, size_t an, const bg_limb *b, size_t bn,
+                            uint64_t g, const BgPrimoNTT *m) {
+    for (size_t i = 0; i < an; i++) fa[i] = ntt_mul(a[i], m->r2, m);
+    memset(fa + an, 0, (n - an) * sizeof(uint64_t));
+    ntt_raices(w, n, g, m);
+    ntt_directa(fa, n, w, m);
+
+    if (a == b && an == bn) {
+        // Cuadrado: una transformada directa menos
+        for (size_t i = 0; i < n; i++) fa[i] = ntt_mul(fa[i], fa[i], m);
+    } else {
+        for (size_t i = 0; i < bn; i++) fb[i] = ntt_mul(b[i], m->r2, m);
+        memset(fb + bn, 0, (n - bn) * sizeof(uint64_t));
+        ntt_directa(fb, n, w, m);
+        for (size_t i = 0; i < n; i++) fa[i] = ntt_mul(fa[i], fb[i], m);
+    }
+    ntt_inversa(fa, n, w, m);
+
+    // (x*R) * n^-1 * R^-1 = x / n, ya fuera de la forma de Montgomery
+    uint64_t n_inv = m->p - (m->p - 1) / n;
+    for (size_t i = 0; i < an + bn - 1; i++) fa[i] = ntt_mul(fa[i], n_inv, m);
+}
+
+// Convolución para un primo como tarea: transforma en espacio propio,
+// pedido a la arena del hilo que la ejecuta, y deja los l coeficientes
+// del producto en res
+typedef struct {
+    BgTarea tarea;
+    uint64_t *res;
+    size_t n;
+    const bg_limb *a, *b;
+    size_t an, bn;
+    uint64_t g;
+    const BgPrimoNTT *m;
+} BgTareaConv;
+
+static void ntt_convolucion_tarea(BgTarea *tarea) {
+    BgTareaConv *t = (BgTareaConv *)tarea;
+    BgArena *previa = bg_temporal_abrir();
+    size_t cap;
+    size_t palabras = 3 * t->n;
+    bg_limb *tmp = bg_trabajo_pedir(palabras * (sizeof(uint64_t) / sizeof(bg_limb)) + 1, &cap);
+    uint64_t *w = (uint64_t *)(((uintptr_t)tmp + 7) & ~(uintptr_t)7);
+    uint64_t *fa = w + t->n, *fb = fa + t->n;
+    ntt_convolucion(fa, fb, w, t->n, t->a, t->an, t->b, t->bn, t->g, t->m);
+    memcpy(t->res, fa, (t->an + t->bn - 1) * sizeof(uint64_t));
+    bg_trabajo_devolver(tmp, cap);
+    bg_temporal_cerrar(previa);
+}
+
+// Saca un bloque del acumulador de 192 bits: c = c / BASE, devuelve c mod BASE
+static inline bg_limb ntt_sacar_bloque(uint64_t *c) {
+#if defined(BG_DECIMAL)
+    uint64_t resto = 0;
+    for (int i = 2; i >= 0; i--) {
+        uint64_t alto = (resto << 32) | (c[i] >> 32);
+        resto = alto % DEC_BASE;
+        uint64_t bajo = (resto << 32) | (uint32_t)c[i];
+        resto = bajo % DEC_BASE;
+        c[i] = ((alto / DEC_BASE) << 32) | (bajo / DEC_BASE);
+    }
+    return (bg_limb)resto;
+#elif BG_LIMB_BITS == 32
+    bg_limb v = (bg_limb)c[0];
+    c[0] = (c[0] >> 32) | (c[1] << 32);
+    c[1] = (c[1] >> 32) | (c[2] << 32);
+    c[2] >>= 32;
+    return v;
+#else
+    bg_limb v = c[0];
+    c[0] = c[1];
+    c[1] = c[2];
+    c[2] = 0;
+    return v;
+#endif
+}
+
+// r (an+bn bloques, distinto de a y b) = a * b por transformada
+static void mag_ntt(bg_limb *r, const bg_limb *a, size_t an,
+                    const bg_limb *b, size_t bn, bg_limb *tmp) {
+    BG_CONTAR_NIVEL(BG_NIVEL_NTT);
+    size_t n = ntt_tamano(an, bn);
+    size_t l = an + bn - 1;                             // coeficientes del producto
+    uint64_t *w = (uint64_t *)(((uintptr_t)tmp + 7) & ~(uintptr_t)7);
+    uint64_t *fa = w + n, *fb = fa + n;
+    uint64_t *r1 = fb + n, *r2 = r1 + l;
+
+    BgPrimoNTT m[3];
+    for (int i = 0; i < 3; i++) ntt_preparar(&m[i], bg_ntt_primos[i]);
+
+    // Con hilos los dos primeros primos van como tareas con su propio
+    // espacio; el tercero se hace aquí en el de tmp
+    BgTareaConv tareas[2];
+    uint64_t *res[2] = { r1, r2 };
+    int par = bg_en_paralelo(bn);
+    for (int i = 0; i < 2; i++) {
+        tareas[i] = (BgTareaConv){ .tarea.fn = ntt_convolucion_tarea, .res = res[i], .n = n,
+                                   .a = a, .an = an, .b = b, .bn = bn,
+                                   .g = bg_ntt_raices[i], .m = &m[i] };
+        if (par) bg_tarea_lanzar(&tareas[i].tarea);
+    }
+    if (!par) {
+        ntt_convolucion(fa, fb, w, n, a, an, b, bn, bg_ntt_raices[0], &m[0]);
+        memcpy(r1, fa, l * sizeof(uint64_t));
+        ntt_convolucion(fa, fb, w, n, a, an, b, bn, bg_ntt_raices[1], &m[1]);
+        memcpy(r2, fa, l * sizeof(uint64_t));
+    }
+    ntt_convolucion(fa, fb, w, n, a, an, b, bn, bg_ntt_raices[2], &m[2]);
+    uint64_t *r3 = fa;
+    if (par) {
+        bg_tarea_esperar(&tareas[1].tarea);
+        bg_tarea_esperar(&tareas[0].tarea);
+    }
+
+    // Constantes de Garner en forma de Montgomery
+    uint64_t p1 = m[0].p, p2 = m[1].p;
+    uint64_t inv_p1_m2 = ntt_potencia(ntt_mul(p1, m[1].r2, &m[1]), m[1].p - 2, &m[1]);
+    uint64_t p1_m3 = ntt_mul(p1, m[2].r2, &m[2]);
+    uint64_t p1p2_m3 = ntt_mul(ntt_mul(p1, p2, &m[2]), m[2].r2, &m[2]);
+    p1p2_m3 = ntt_mul(p1p2_m3, m[2].r2, &m[2]);
+    uint64_t inv_p1p2_m3 = ntt_potencia(p1p2_m3, m[2].p - 2, &m[2]);
+    bg_u128 p1p2 = (bg_u128)p1 * p2;
+    uint64_t p1p2_bajo = (uint64_t)p1p2, p1p2_alto = (uint64_t)(p1p2 >> 64);
+
+    uint64_t c[3] = {0, 0, 0};
+    for (size_t i = 0; i < l; i++) {
+        // x = t1 + t2*p1 + t3*p1*p2
+        uint64_t t1 = r1[i];
+        uint64_t t2 = ntt_mul(ntt_restar(r2[i], t1, p2), inv_p1_m2, &m[1]);
+        uint64_t y = ntt_sumar(t1, ntt_mul(t2, p1_m3, &m[2]), m[2].p);
+        uint64_t t3 = ntt_mul(ntt_restar(r3[i], y, m[2].p), inv_p1p2_m3, &m[2]);
+
+        bg_u128 bajo = (bg_u128)t2 * p1 + t1;
+        bg_u128 x0 = (bg_u128)t3 * p1p2_bajo;
+        bg_u128 x1 = (bg_u128)t3 * p1p2_alto + (uint64_t)(x0 >> 64);
+
+        // c += x, en tres palabras
+        bg_u128 s = (bg_u128)c[0] + (uint64_t)x0 + (uint64_t)bajo;
+        c[0] = (uint64_t)s;
+        s = (s >> 64) + c[1] + (uint64_t)x1 + (uint64_t)(bajo >> 64);
+        c[1] = (uint64_t)s;
+        c[2] += (uint64_t)(s >> 64) + (uint64_t)(x1 >> 64);
+
+        r[i] = ntt_sacar_bloque(c);
+    }
+    r[l] = ntt_sacar_bloque(c);
+}
+#endif /* BG_NTT */
+
+
+// Karatsuba para cuadrados: r (2n bloques, distinto de a) = a^2 con tres
+// cuadrados por nivel, z1 = z0 + z2 - (aL-aH)^2, que siempre es >= 0
+static void mag_sqr_karatsuba(bg_limb *r, const bg_limb *a, size_t n, bg_limb *tmp) {
+    BG_CONTAR_NIVEL(BG_NIVEL_KARATSUBA_SQR);
+    size_t m = (n + 1) / 2;
+    size_t h = n - m;
+    bg_limb *d = tmp;
+    bg_limb *p = d + m;
+    bg_limb *t = p + 2 * m;
+    bg_limb *resto_tmp = t + 2 * m + 1;
+
+    mag_diferencia(d, a, m, a + m, h);
+    int par = bg_en_paralelo(n);
+    BgTareaMul tareas[2];
+    mag_mul_repartir(&tareas[0], par, r + 2 * m, a + m, h, a + m, h, resto_tmp); // z2
+    mag_mul_repartir(&tareas[1], par, p, d, m, d, m, resto_tmp);    // (aL-aH)^2
+    mag_sqr(r, a, m, resto_tmp);                                    // z0
+    mag_mul_recoger(&tareas[1], par);
+    mag_mul_recoger(&tareas[0], par);
+
+    t[2 * m] = mag_sumar(t, r, 2 * m, r + 2 * m, 2 * h);
+    mag_restar(t, t, 2 * m + 1, p, 2 * m);
+    size_t tn = mag_normalizar(t, 2 * m + 1);
+
+    mag_sumar(r + m, r + m, 2 * n - m, t, tn);
+}
+
+// r (2n bloques) = a^2, eligiendo el nivel como mag_mul
+static void mag_sqr(bg_limb *r, const bg_limb *a, size_t n, bg_limb *tmp) {
+    BG_RECURSION_ENTRAR();
+    if (n < bg_umbral.karatsuba_sqr) mag_sqr_basecase(r, a, n);
+#ifdef BG_NTT
+    else if (n >= bg_umbral.ntt)     mag_ntt(r, a, n, a, n, tmp);
+#endif
+    else if (mag_usar_toom3(n, n))   mag_toom3(r, a, n, a, n, tmp);
+    else                             mag_sqr_karatsuba(r, a, n, tmp);
+    BG_RECURSION_SALIR();
+}
+
+
+// mag_mul tomando el espacio de trabajo de la arena temporal (ámbito abierto)
+static void mag_multiplicar(bg_limb *r, const bg_limb *a, size_t an,
+                            const bg_limb *b, size_t bn) {
+    size_t cap;
+    bg_limb *tmp = bg_trabajo_pedir(mag_mul_espacio(an, bn), &cap);
+    mag_mul(r, a, an, b, bn, tmp);
+    bg_trabajo_devolver(tmp, cap);
+}
+
+
+// Fija la longitud de r quitando ceros no significativos
+static void bg_fijar_longitud(BigInt *r, size_t n) {
+    r->longitud = mag_normalizar(r->bloques, n);
+    if (r->longitud == 1 && r->bloques[0] == 0) r->signo = +1;
+}
+
+// dst = a, reutilizando los bloques de dst
+static void bg_copiar_en(BigInt *dst, const BigInt *a) {
+    if (dst == a) return;
+    bg_crecer(dst, a->longitud);
+    memcpy(dst->bloques, a->bloques, a->longitud * sizeof(bg_limb));
+    dst->longitud = a->longitud;
+    dst->signo = a->signo;
+}
+
+// dst = v, un doble bloque (tres bloques en base 10^9)
+static void bg_fijar_doble(BigInt *dst, bg_dlimb v) {
+    bg_crecer(dst, 3);
+    size_t n = 0;
+    do {
+        dst->bloques[n++] = (bg_limb)(v % BG_BASE);
+        v /= BG_BASE;
+    } while (v);
+    dst->signo = +1;
+    bg_fijar_longitud(dst, n);
+}
+
+// dst = v
+void bg_fijar_entero(BigInt *dst, long long v) {
+    bg_fijar_doble(dst, v < 0 ? -(unsigned long long)v : (unsigned long long)v);
+    if (v < 0) dst->signo = -1;
+}
+
+// dst = a + signo_b * |b|. dst puede ser a, b o ambos.
+static void sumar_en(BigInt *dst, const BigInt *a, const BigInt *b, int signo_b) {
+    int sa = a->signo;
+    size_t an = a->longitud, bn = b->longitud;
+    size_t max_len = an > bn ? an : bn;
+    bg_crecer(dst, max_len + 1);
+
+    // Tras crecer, dst->bloques puede haber cambiado si dst es a o b
+    const bg_limb *pa = a->bloques, *pb = b->bloques;
+    bg_limb *r = dst->bloques;
+
+    if (sa == signo_b) {
+        bg_limb acarreo = an >= bn ? mag_sumar(r, pa, an, pb, bn)
+                                    : mag_sumar(r, pb, bn, pa, an);
+        r[max_len] = acarreo;
+        dst->signo = sa;
+        bg_fijar_longitud(dst, max_len + 1);
+        return;
+    }
+
+    int comparacion = mag_comparar(pa, an, pb, bn);
+    if (comparacion >= 0) {
+        mag_restar(r, pa, an, pb, bn);
+        dst->signo = sa;
+        bg_fijar_longitud(dst, an);
+    } else {
+        mag_restar(r, pb, bn, pa, an);
+        dst->signo = signo_b;
+        bg_fijar_longitud(dst, bn);
+    }
+}
+
+// dst = a + b
+void bg_add_into(BigInt *dst, const BigInt *a, const BigInt *b) {
+    BG_OP_INICIO();
+    sumar_en(dst, a, b, b->signo);
+    BG_OP_FIN(BG_OP_SUMAR);
+}
+
+// dst = a - b
+void bg_sub_into(BigInt *dst, const BigInt *a, const BigInt *b) {
+    BG_OP_INICIO();
+    sumar_en(dst, a, b, -b->signo);
+    BG_OP_FIN(BG_OP_RESTAR);
+}
+
+// dst += a * w, con w un bloque. dst puede ser a.
+void bg_addmul_word_into(BigInt *dst, const BigInt *a, bg_limb w) {
+    size_t an = a->longitud;
+    size_t dn = dst->longitud;
+    size_t n = (an > dn ? an : dn) + 1;
+    int signo_a = a->signo;
+
+    bg_crecer(dst, n);
+    memset(dst->bloques + dn, 0, (n - dn) * sizeof(bg_limb));
+    // Si dst es a, cada bloque se lee antes de sobrescribirse
+    const bg_limb *pa = a->bloques;
+    bg_limb *r = dst->bloques;
+
+    if (dst->signo == signo_a || (dn == 1 && r[0] == 0)) {
+        bg_limb acarreo = mag_addmul_1(r, pa, an, w);
+        mag_incrementar(r + an, n - an, acarreo);
+        dst->signo = signo_a;
+    } else {
+        // Restar y propagar; si no alcanza, el resultado cambia de signo
+        bg_limb resta = mag_submul_1(r, pa, an, w);
+        bg_limb prestamo = 0;
+        for (size_t i = an; i < n; i++) {
+            r[i] = bg_restac(r[i], resta, &prestamo);
+            resta = 0;
+        }
+        if (prestamo) {
+            mag_complementar(r, n);
+            dst->signo = -dst->signo;
+        }
+    }
+    bg_fijar_longitud(dst, n);
+}
+
+static void cuadrado_en(BigInt *dst, const BigInt *a);
+
+// dst = a * b; dst puede ser a o b
+static void mul_en(BigInt *dst, const BigInt *a, const BigInt *b) {
+    if (a == b) {
+        cuadrado_en(dst, a);
+        return;
+    }
+    if (dst == a || dst == b) {
+        BgArena *previa = bg_temporal_abrir();
+        BigInt *copia = bg_clone(dst);
+        mul_en(dst, dst == a ? copia : a, dst == b ? copia : b);
+        bg_liberar(copia);
+        bg_temporal_cerrar(previa);
+        return;
+    }
+
+    size_t an = a->longitud, bn = b->longitud;
+    bg_crecer(dst, an + bn);
+
+    BgArena *previa = bg_temporal_abrir();
+    mag_multiplicar(dst->bloques, a->bloques, an, b->bloques, bn);
+    bg_temporal_cerrar(previa);
+
+    dst->signo = a->signo * b->signo;
+    bg_fijar_longitud(dst, an + bn);
+}
+
+// dst = a^2; dst puede ser a
+static void cuadrado_en(BigInt *dst, const BigInt *a) {
+    if (dst == a) {
+        BgArena *previa = bg_temporal_abrir();
+        BigInt *copia = bg_clone(a);
+        cuadrado_en(dst, copia);
+        bg_liberar(copia);
+        bg_temporal_cerrar(previa);
+        return;
+    }
+
+    size_t n = a->longitud;
+    bg_crecer(dst, 2 * n);
+
+    BgArena *previa = bg_temporal_abrir();
+    size_t cap;
+    bg_limb *tmp = bg_trabajo_pedir(mag_sqr_espacio(n), &cap);
+    mag_sqr(dst->bloques, a->bloques, n, tmp);
+    bg_trabajo_devolver(tmp, cap);
+    bg_temporal_cerrar(previa);
+
+    dst->signo = +1;
+    bg_fijar_longitud(dst, 2 * n);
+}
+
+// dst = a * b (escolar, Karatsuba, Toom-3 o NTT según el tamaño); dst puede ser a o b
+void bg_mul_into(BigInt *dst, const BigInt *a, const BigInt *b) {
+    BG_OP_INICIO();
+    mul_en(dst, a, b);
+    BG_OP_FIN(BG_OP_MULTIPLICAR);
+}
+
+// dst = a^2 calculando cada producto cruzado una sola vez; dst puede ser a
+void bg_square_into(BigInt *dst, const BigInt *a) {
+    BG_OP_INICIO();
+    cuadrado_en(dst, a);
+    BG_OP_FIN(BG_OP_CUADRADO);
+}
+
+
+// ---------------------------------------------------------------------
+// Recíproco de Newton y división por un divisor fijo
+//
+// mag_reciproco calcula floor(BASE^(2n) / d) duplicando la precisión en
+// cada paso, así que cuesta un número constante de multiplicaciones de
+// tamaño n. Con el recíproco, dividir un número de hasta 2n bloques
+// entre d se reduce a dos multiplicaciones y unas pocas correcciones.
+// Todas estas funciones piden su memoria al ámbito temporal abierto.
+// ---------------------------------------------------------------------
+
+// x (n+1 bloques) = floor(BASE^(2n) / d), con d normalizado (bloque alto >= BASE/2)
+static void mag_reciproco(bg_limb *x, const bg_limb *d, size_t n) {
+    if (n == 1) {
+#ifdef BG_DECIMAL
+        bg_dlimb q = ((bg_dlimb)DEC_BASE * DEC_BASE) / d[0];
+#else
+        // BASE^2 no cabe en bg_dlimb: (BASE^2 - 1) / d solo difiere
+        // cuando d divide a BASE^2, es decir, cuando d = BASE/2
+        bg_dlimb q = (~(bg_dlimb)0) / d[0];
+        if (d[0] == (bg_limb)1 << (BG_LIMB_BITS - 1)) q++;
+#endif
+        x[0] = BG_BAJO(q);
+        x[1] = BG_ALTO(q);
+        return;
+    }
+
+    // x0 = recíproco de los h bloques altos, desplazado l bloques
+    size_t h = (n + 1) / 2, l = n - h;
+    bg_limb *xh = x + l;
+    mag_reciproco(xh, d + l, h);
+    memset(x, 0, l * sizeof(bg_limb));
+
+    // Paso de Newton: x1 = x0 + x0 * (BASE^(2n) - d*x0) / BASE^(2n).
+    // Como x0 = xh * BASE^l, basta E = BASE^(n+h) - d*xh y
+    // x1 = x0 + xh * E / BASE^(2h).
+    size_t cap_p, cap_t;
+    size_t pn = n + h + 1;
+    bg_limb *p = bg_trabajo_pedir(pn, &cap_p);
+    mag_multiplicar(p, d, n, xh, h + 1);
+    int signo;
+    size_t en;
+    if (p[n + h] == 0) {
+        mag_complementar(p, n + h);
+        signo = 1;
+        en = n + h;
+    } else {
+        p[n + h] -= 1;
+        signo = -1;
+        en = pn;
+    }
+    en = mag_normalizar(p, en);
+
+    bg_limb *t = bg_trabajo_pedir(h + 1 + en, &cap_t);
+    mag_multiplicar(t, xh, h + 1, p, en);
+    if (h + 1 + en > 2 * h) {
+        size_t cn = mag_normalizar(t + 2 * h, h + 1 + en - 2 * h);
+        if (signo > 0) mag_sumar(x, x, n + 1, t + 2 * h, cn);
+        else           mag_restar(x, x, n + 1, t + 2 * h, cn);
+    }
+    bg_trabajo_devolver(t, cap_t);
+    bg_trabajo_devolver(p, cap_p);
+
+    // Corrección final: dejar 0 <= BASE^(2n) - d*x < d
+    size_t cap_q;
+    bg_limb *q = bg_trabajo_pedir(2 * n + 1, &cap_q);
+    mag_multiplicar(q, d, n, x, n + 1);
+    if (q[2 * n] == 0) {
+        mag_complementar(q, 2 * n);                  // q = R >= 0
+        while (mag_comparar(q, 2 * n, d, n) >= 0) {
+            mag_incrementar(x, n + 1, 1);
+            mag_restar(q, q, 2 * n, d, n);
+        }
+    } else {
+        q[2 * n] -= 1;                               // q = -R
+        size_t qn = 2 * n + 1;
+        while (mag_normalizar(q, qn) > 1 || q[0] != 0) {
+            mag_restar(x, x, n + 1, (const bg_limb[]){1}, 1);
+            if (mag_comparar(q, qn, d, n) < 0) break;
+            mag_restar(q, q, qn, d, n);
+        }
+    }
+    bg_trabajo_devolver(q, cap_q);
+}
+
+// q = floor(a / d), r = a mod d, con d normalizado de n bloques,
+// x = mag_reciproco(d) y an <= 2n. q recibe n+1 bloques y r n bloques.
+static void mag_divrem_reciproco(bg_limb *q, bg_limb *r, const bg_limb *a, size_t an,
+                                 const bg_limb *d, size_t n, const bg_limb *x) {
+    memset(q, 0, (n + 1) * sizeof(bg_limb));
+    if (an < n) {
+        memcpy(r, a, an * sizeof(bg_limb));
+        memset(r + an, 0, (n - an) * sizeof(bg_limb));
+        return;
+    }
+
+    // q0 = floor(floor(a / BASE^(n-1)) * x / BASE^(n+1)) no supera al cociente
+    size_t hn = an - (n - 1);
+    size_t cap_t, cap_m;
+    bg_limb *t = bg_trabajo_pedir(hn + n + 1, &cap_t);
+    mag_multiplicar(t, a + n - 1, hn, x, n + 1);
+    memcpy(q, t + n + 1, hn * sizeof(bg_limb));
+    bg_trabajo_devolver(t, cap_t);
+
+    // m = a - q0*d, seguido de las pocas correcciones que falten
+    size_t qn = mag_normalizar(q, n + 1);
+    size_t mn = qn + n > an ? qn + n : an;
+    bg_limb *m = bg_trabajo_pedir(mn, &cap_m);
+    bg_limb *qd = bg_trabajo_pedir(qn + n, &cap_t);
+    mag_multiplicar(qd, q, qn, d, n);
+    memcpy(m, a, an * sizeof(bg_limb));
+    memset(m + an, 0, (mn - an) * sizeof(bg_limb));
+    mag_restar(m, m, mn, qd, mag_normalizar(qd, qn + n));
+    bg_trabajo_devolver(qd, cap_t);
+
+    while (mag_comparar(m, mn, d, n) >= 0) {
+        BG_CONTAR(correcciones_div, 1);
+        mag_incrementar(q, n + 1, 1);
+        mag_restar(m, m, mn, d, n);
+    }
+    memcpy(r, m, n * sizeof(bg_limb));
+    bg_trabajo_devolver(m, cap_m);
+}
+
+
+// ---------------------------------------------------------------------
+// Conversión decimal
+//
+// En las bases binarias la lectura y la escritura dividen el problema en
+// dos mitades usando potencias 10^(BG_TROZO_DIGITOS * 2^k) que se
+// calculan una vez y se guardan, junto con su recíproco:
+//   leer:     valor(alto ++ bajo) = valor(alto) * 10^d + valor(bajo)
+//   escribir: a = q * 10^d + r, y se escriben q y r por separado
+// Así ambas cuestan O(M(n) log n) con la multiplicación rápida. Los
+// trozos pequeños usan el método cuadrático.
+// ---------------------------------------------------------------------
+
+// Valor de los dígitos decimales s[0..n)
+static bg_limb bg_leer_trozo(const char *s, size_t n) {
+    bg_limb v = 0;
+    for (size_t i = 0; i < n; i++)
+        v = v * 10 + (bg_limb)(s[i] - '0');
+    return v;
+}
+
+// Escribe v con exactamente n dígitos, con ceros a la izquierda
+static void bg_escribir_trozo(char *out, bg_limb v, size_t n) {
+    for (size_t i = n; i-- > 0; ) {
+        out[i] = (char)('0' + v % 10);
+        v /= 10;
+    }
+}
+
+#ifndef BG_DECIMAL
+
+// log2(10) por exceso, para acotar los bloques de un número de len dígitos
+static size_t bg_bloques_para_digitos(size_t len) {
+    return (size_t)((double)len * 3.3219280948873626 / BG_LIMB_BITS) + 4;
+}
+
+// r = a << s bits (0 <= s < BG_LIMB_BITS); devuelve los bits que salen por arriba
+static bg_limb mag_lshift(bg_limb *r, const bg_limb *a, size_t n, unsigned s) {
+    if (s == 0) {
+        memmove(r, a, n * sizeof(bg_limb));
+        return 0;
+    }
+    bg_limb salida = a[n-1] >> (BG_LIMB_BITS - s);
+    for (size_t i = n - 1; i > 0; i--)
+        r[i] = (a[i] << s) | (a[i-1] >> (BG_LIMB_BITS - s));
+    r[0] = a[0] << s;
+    return salida;
+}
+
+// r = a >> s bits (0 <= s < BG_LIMB_BITS); devuelve los bits que salen por abajo
+static bg_limb mag_rshift(bg_limb *r, const bg_limb *a, size_t n, unsigned s) {
+    if (s == 0) {
+        memmove(r, a, n * sizeof(bg_limb));
+        return 0;
+    }
+    bg_limb salida = a[0] << (BG_LIMB_BITS - s);
+    for (size_t i = 0; i + 1 < n; i++)
+        r[i] = (a[i] >> s) | (a[i+1] << (BG_LIMB_BITS - s));
+    r[n-1] = a[n-1] >> s;
+    return salida;
+}
+
+// 10^digitos, normalizada y con su recíproco
+typedef struct {
+    bg_limb *p;           // 10^digitos
+    size_t pn;
+    bg_limb *d;           // p << s, con el bit alto encendido
+    bg_limb *inv;         // mag_reciproco(d), pn+1 bloques; se calcula al usarse
+    unsigned s;
+    size_t digitos;       // BG_TROZO_DIGITOS * 2^k
+} BgPotencia10;
+
+#define BG_MAX_POTENCIAS 48
+static BgPotencia10 bg_pot10[BG_MAX_POTENCIAS];
+static int bg_pot10_n = 0;
+
+// Potencia k de la tabla, construyéndola por cuadrados si hace falta
+static const BgPotencia10* bg_potencia10(int k, int con_inverso) {
+    while (bg_pot10_n <= k) {
+        BgPotencia10 *e = &bg_pot10[bg_pot10_n];
+        if (bg_pot10_n == 0) {
+            e->pn = 1;
+            e->p = malloc(sizeof(bg_limb));
+            e->p[0] = BG_TROZO_DEC;
+            e->digitos = BG_TROZO_DIGITOS;
+        } else {
+            const BgPotencia10 *a = &bg_pot10[bg_pot10_n - 1];
+            e->p = malloc(2 * a->pn * sizeof(bg_limb));
+            mag_multiplicar(e->p, a->p, a->pn, a->p, a->pn);
+            e->pn = mag_normalizar(e->p, 2 * a->pn);
+            e->digitos = 2 * a->digitos;
+        }
+        e->s = BG_CLZ(e->p[e->pn - 1]);
+        e->d = malloc(e->pn * sizeof(bg_limb));
+        mag_lshift(e->d, e->p, e->pn, e->s);
+        e->inv = NULL;
+        bg_pot10_n++;
+    }
+    BgPotencia10 *e = &bg_pot10[k];
+    if (con_inverso && !e->inv) {
+        e->inv = malloc((e->pn + 1) * sizeof(bg_limb));
+        mag_reciproco(e->inv, e->d, e->pn);
+    }
+    return e;
+}
+
+// r = valor de s[0..len) por Horner sobre trozos; devuelve la longitud
+static size_t conv_leer_basico(bg_limb *r, const char *s, size_t len) {
+    BG_CONTAR_NIVEL(BG_NIVEL_CONV_BASICA);
+    size_t n = 1;
+    r[0] = 0;
+    size_t primero = len % BG_TROZO_DIGITOS;
+    if (primero == 0) primero = BG_TROZO_DIGITOS;
+    for (size_t i = 0; i < len; ) {
+        size_t k = i == 0 ? primero : BG_TROZO_DIGITOS;
+        bg_limb potencia = 1;
+        for (size_t j = 0; j < k; j++) potencia *= 10;
+        bg_limb acarreo = mag_mul_1(r, r, n, potencia);
+        acarreo += mag_incrementar(r, n, bg_leer_trozo(s + i, k));
+        if (acarreo) r[n++] = acarreo;
+        i += k;
+    }
+    return n;
+}
+
+// r (bg_bloques_para_digitos(len) bloques) = valor de s[0..len)
+static size_t conv_leer(bg_limb *r, const char *s, size_t len) {
+    if (len <= bg_umbral.conv * BG_TROZO_DIGITOS)
+        return conv_leer_basico(r, s, len);
+    BG_CONTAR_NIVEL(BG_NIVEL_CONV_RECURSIVA);
+
+    // La mayor potencia con menos dígitos que s separa la parte baja
+    int k = 0;
+    while (bg_potencia10(k + 1, 0)->digitos < len) k++;
+    const BgPotencia10 *p = bg_potencia10(k, 0);
+    size_t alto = len - p->digitos;
+
+    size_t cap_h, cap_t;
+    bg_limb *h = bg_trabajo_pedir(bg_bloques_para_digitos(alto), &cap_h);
+    size_t hn = conv_leer(h, s, alto);
+    size_t ln = conv_leer(r, s + alto, p->digitos);
+
+    size_t tn = hn + p->pn;
+    bg_limb *t = bg_trabajo_pedir(tn, &cap_t);
+    mag_multiplicar(t, h, hn, p->p, p->pn);
+    r[tn] = mag_sumar(r, t, tn, r, ln);
+    bg_trabajo_devolver(t, cap_t);
+    bg_trabajo_devolver(h, cap_h);
+    return mag_normalizar(r, tn + 1);
+}
+
+// Escribe exactamente 2 * digitos(k) dígitos de a < 10^(2 * digitos(k))
+static void conv_escribir(char *out, const bg_limb *a, size_t n, int k) {
+    n = mag_normalizar(a, n);
+    size_t total = 2 * (BG_TROZO_DIGITOS << k);
+
+    if (n <= bg_umbral.conv) {
+        BG_CONTAR_NIVEL(BG_NIVEL_CONV_BASICA);
+        size_t cap;
+        bg_limb *q = bg_trabajo_pedir(n, &cap);
+        memcpy(q, a, n * sizeof(bg_limb));
+        size_t pos = total;
+        while (pos > 0 && (n > 1 || q[0] != 0)) {
+            bg_limb trozo = mag_divrem_1(q, q, n, BG_TROZO_DEC);
+            n = mag_normalizar(q, n);
+            pos -= BG_TROZO_DIGITOS;
+            bg_escribir_trozo(out + pos, trozo, BG_TROZO_DIGITOS);
+        }
+        memset(out, '0', pos);
+        bg_trabajo_devolver(q, cap);
+        return;
+    }
+    BG_CONTAR_NIVEL(BG_NIVEL_CONV_RECURSIVA);
+
+    // a = q * 10^digitos(k) + r, con q y r menores que 10^digitos(k)
+    const BgPotencia10 *p = bg_potencia10(k, 1);
+    size_t pn = p->pn;
+    size_t cap_a, cap_q, cap_r;
+    bg_limb *an = bg_trabajo_pedir(2 * pn, &cap_a);
+    bg_limb *q  = bg_trabajo_pedir(pn + 1, &cap_q);
+    bg_limb *r  = bg_trabajo_pedir(pn, &cap_r);
+    memset(an, 0, 2 * pn * sizeof(bg_limb));
+    bg_limb alto = mag_lshift(an, a, n, p->s);    // a << s < d * p cabe en 2pn bloques
+    if (n < 2 * pn) an[n] = alto;
+    mag_divrem_reciproco(q, r, an, 2 * pn, p->d, pn, p->inv);
+    mag_rshift(r, r, pn, p->s);
+    bg_trabajo_devolver(an, cap_a);
+
+    conv_escribir(out, q, pn + 1, k - 1);
+    conv_escribir(out + p->digitos, r, pn, k - 1);
+    bg_trabajo_devolver(q, cap_q);
+    bg_trabajo_devolver(r, cap_r);
+}
+
+#endif /* !BG_DECIMAL */
+
+
+static BigInt* desde_cadena(const char *s) {
+    BigInt *r = bg_nuevo();
+    if (*s=='+'||*s=='-') {
+        if (*s=='-') r->signo = -1;
+        s++;
+    }
+    size_t len = strlen(s);
+#ifdef BG_DECIMAL
+    BgConstructor c;
+    bg_constructor_iniciar(&c, r, len / DEC_DIGITS + 1);
+    for (int i = (int)len; i > 0; i -= DEC_DIGITS) {
+        int start = i - DEC_DIGITS;
+        if (start < 0) start = 0;
+        bg_constructor_poner(&c, bg_leer_trozo(s + start, i - start));
+    }
+    return bg_constructor_terminar(&c);
+#else
+    if (len == 0) {
+        bg_append(r, 0);
+        return r;
+    }
+    bg_crecer(r, bg_bloques_para_digitos(len));
+    BgArena *previa = bg_temporal_abrir();
+    size_t n = conv_leer(r->bloques, s, len);
+    bg_temporal_cerrar(previa);
+    bg_fijar_longitud(r, n);
+    return r;
+#endif
+}
+
+BigInt* bg_desde_cadena(const char *s) {
+    BG_OP_INICIO();
+    BigInt *r = desde_cadena(s);
+    BG_OP_FIN(BG_OP_LEER);
+    return r;
+}
+
+static char* a_cadena(const BigInt *a) {
+    size_t n = a->longitud;
+#ifdef BG_DECIMAL
+    char *s = malloc(n * DEC_DIGITS + 2);
+    char *p = s;
+    if (a->signo < 0) *p++ = '-';
+    p += sprintf(p, "%" PRIu32, a->bloques[n-1]);
+    for (size_t i = n - 1; i-- > 0; p += DEC_DIGITS)
+        bg_escribir_trozo(p, a->bloques[i], DEC_DIGITS);
+    *p = '\0';
+    return s;
+#else
+    // Menor k con 2 * digitos(k) >= dígitos posibles de a
+    size_t max_digitos = (size_t)((double)n * BG_LIMB_BITS * 0.30102999566398120) + 1;
+    int k = 0;
+    while (2 * ((size_t)BG_TROZO_DIGITOS << k) < max_digitos) k++;
+    size_t total = 2 * ((size_t)BG_TROZO_DIGITOS << k);
+
+    char *s = malloc(total + 2);
+    BgArena *previa = bg_temporal_abrir();
+    conv_escribir(s + 1, a->bloques, n, k);
+    bg_temporal_cerrar(previa);
+
+    // Quitar ceros a la izquierda (queda al menos un dígito)
+    size_t inicio = 1;
+    while (inicio < total && s[inicio] == '0') inicio++;
+    size_t largo = total + 1 - inicio;
+    if (a->signo < 0) {
+        s[0] = '-';
+        memmove(s + 1, s + inicio, largo);
+        s[largo + 1] = '\0';
+    } else {
+        memmove(s, s + inicio, largo);
+        s[largo] = '\0';
+    }
+    return s;
+#endif
+}
+
+// Representación decimal de a en una cadena nueva (liberar con free)
+char* bg_a_cadena(const BigInt *a) {
+    BG_OP_INICIO();
+    char *s = a_cadena(a);
+    BG_OP_FIN(BG_OP_ESCRIBIR);
+    return s;
+}
+
+
+void printBigInt(const BigInt *a) {
+    char *s = bg_a_cadena(a);
+    fputs(s, stdout);
+    putchar('\n');
+    free(s);
+}
+
+
+// Función principal de suma
+BigInt* sumar(const BigInt *a, const BigInt *b) {
+    BigInt *resultado = bg_nuevo();
+    bg_add_into(resultado, a, b);
+    return resultado;
+}
+
+// Multiplicación clásica: una fila a * b[j] por bloque de b, acumulada
+// directamente sobre el resultado
+BigInt* multiplicar(const BigInt *a, const BigInt *b) {
+    BigInt *resultado = bg_nuevo();
+    bg_crecer(resultado, a->longitud + b->longitud);
+    if (a == b)
+        mag_sqr_basecase(resultado->bloques, a->bloques, a->longitud);
+    else
+        mag_mul_basecase(resultado->bloques, a->bloques, a->longitud,
+                         b->bloques, b->longitud);
+    resultado->signo = a->signo * b->signo;
+    bg_fijar_longitud(resultado, a->longitud + b->longitud);
+    return resultado;
+}
+
+
+//Clona un BigInt completo:
+BigInt* bg_clone(const BigInt *a) {
+    BigInt *r = bg_nuevo();
+    r->signo = a->signo;
+    bg_reservar(r, a->longitud);
+    memcpy(r->bloques, a->bloques, a->longitud * sizeof(bg_limb));
+    r->longitud = a->longitud;
+    return r;
+}
+
+//Desplaza un BigInt por 'bloques' posiciones (multiplica por BASE^bloques):
+BigInt* bg_shift(const BigInt *a, size_t bloques) {
+    BigInt *r = bg_nuevo();
+    r->signo = a->signo;
+    bg_crecer(r, a->longitud + bloques);
+    memset(r->bloques, 0, bloques * sizeof(bg_limb));
+    memcpy(r->bloques + bloques, a->bloques, a->longitud * sizeof(bg_limb));
+    r->longitud = a->longitud + bloques;
+    return r;
+}
+
+//Suma dos BigInt asumiendo magnitud:
+BigInt* bg_sumar_magnitud(const BigInt *a, const BigInt *b) {
+    BigInt *resultado = bg_nuevo();
+    BigInt va = *a, vb = *b;      // vistas con signo positivo, sin copiar bloques
+    va.signo = 1;
+    vb.signo = 1;
+    bg_add_into(resultado, &va, &vb);
+    return resultado;
+}
+
+//Resta b de a, asumiendo a >= b en magnitud:
+BigInt* bg_restar_magnitud(const BigInt *a, const BigInt *b) {
+    BigInt *resultado = bg_nuevo();
+    BigInt va = *a, vb = *b;
+    va.signo = 1;
+    vb.signo = 1;
+    bg_sub_into(resultado, &va, &vb);
+    return resultado;
+}
+
+// Función para dividir un BigInt en dos partes
+void bg_split(const BigInt *orig, size_t m, BigInt **pLow, BigInt **pHigh) {
+    *pLow  = bg_nuevo();
+    *pHigh = bg_nuevo();
+    (*pLow)->signo  = orig->signo;
+    (*pHigh)->signo = orig->signo;
+
+    size_t n_low = orig->longitud < m ? orig->longitud : m;
+    bg_crecer(*pLow, n_low);
+    memcpy((*pLow)->bloques, orig->bloques, n_low * sizeof(bg_limb));
+    (*pLow)->longitud = n_low;
+
+    if (orig->longitud > m) {
+        size_t n_high = orig->longitud - m;
+        bg_crecer(*pHigh, n_high);
+        memcpy((*pHigh)->bloques, orig->bloques + m, n_high * sizeof(bg_limb));
+        (*pHigh)->longitud = n_high;
+    }
+
+    // Si pHigh está vacío, agregar un 0
+    if ((*pHigh)->longitud == 0) {
+        bg_append(*pHigh, 0);
+    }
+}
+
+//Multiplicación rápida: el resultado se escribe directamente en un
+//BigInt nuevo y el espacio de trabajo sale de la arena temporal. Pese al
+//nombre, por encima del umbral de Toom-3 usa Toom-3.
+BigInt* bg_multiplicarKaratsuba(const BigInt *a, const BigInt *b) {
+    BigInt *resultado = bg_nuevo();
+    bg_mul_into(resultado, a, b);
+    return resultado;
+}
+
+// Cuadrado: la mitad de productos cruzados en el escolar y tres
+// cuadrados por nivel en Karatsuba
+BigInt* bg_square(const BigInt *a) {
+    BigInt *resultado = bg_nuevo();
+    bg_square_into(resultado, a);
+    return resultado;
+}
+
+
+// Devuelve 1 si BigInt a es cero
+int bg_es_cero(const BigInt *a) {
+    return (a->longitud == 1 && a->bloques[0] == 0);
+}
+
+// Devuelve un BigInt con valor cero
+BigInt* bg_cero() {
+    BigInt *r = bg_nuevo();
+    bg_append(r, 0);
+    return r;
+}
+
+// Devuelve un BigInt con valor uno
+BigInt* bg_uno() {
+    BigInt *r = bg_nuevo();
+    bg_append(r, 1);
+    return r;
+}
+
+// División larga de Knuth (algoritmo D): q (an-n+1 bloques) = a / d y
+// r (n bloques) = a mod d, con an >= n >= 2 y d[n-1] != 0. Multiplicar
+// ambos por f = BASE / (d[n-1] + 1) no cambia el cociente y deja el
+// bloque alto del divisor >= BASE/2; así cada bloque del cociente se
+// estima con los tres bloques altos del resto y se corrige a lo sumo dos
+// veces. El resto se actualiza en su sitio con mag_submul_1. Pide su
+// memoria al ámbito temporal abierto.
+static void mag_divrem_knuth(bg_limb *q, bg_limb *r, const bg_limb *a, size_t an,
+                             const bg_limb *d, size_t n) {
+    BG_CONTAR_NIVEL(BG_NIVEL_KNUTH);
+    size_t cap_u, cap_v;
+    bg_limb *u = bg_trabajo_pedir(an + 1, &cap_u);
+    bg_limb *v = bg_trabajo_pedir(n, &cap_v);
+    bg_limb f = (bg_limb)(BG_BASE / ((bg_dlimb)d[n - 1] + 1));
+    mag_mul_1(v, d, n, f);
+    u[an] = mag_mul_1(u, a, an, f);
+    bg_limb v1 = v[n - 1], v2 = v[n - 2];
+
+    for (size_t j = an - n + 1; j-- > 0; ) {
+        // u[j+n] <= v1, así que qhat <= BASE + 1 y solo sobra por 2
+        bg_dlimb num = BG_JUNTAR(u[j + n], u[j + n - 1]);
+        bg_dlimb qhat = num / v1, rhat = num % v1;
+        while (qhat > BG_MAX || qhat * v2 > BG_JUNTAR(rhat, u[j + n - 2])) {
+            BG_CONTAR(correcciones_div, 1);
+            qhat--;
+            rhat += v1;
+            if (rhat > BG_MAX) break;
+        }
+
+        bg_limb prestamo = 0;
+        bg_limb resta = mag_submul_1(u + j, v, n, (bg_limb)qhat);
+        u[j + n] = bg_restac(u[j + n], resta, &prestamo);
+        if (prestamo) {
+            // Caso raro (probabilidad ~2/BASE): qhat se pasó por uno
+            BG_CONTAR(correcciones_div, 1);
+            qhat--;
+            bg_limb acarreo = mag_sumar(u + j, u + j, n, v, n);
+            prestamo = 0;                   // el acarreo de salida anula el préstamo
+            u[j + n] = bg_sumac(u[j + n], acarreo, &prestamo);
+        }
+        q[j] = (bg_limb)qhat;
+    }
+
+    mag_divrem_1(r, u, n, f);                 // deshacer la normalización
+    bg_trabajo_devolver(v, cap_v);
+    bg_trabajo_devolver(u, cap_u);
+}
+
+// División por el recíproco de Newton: q (an-n+1 bloques) = a / d y
+// r (n bloques) = a mod d. Tras normalizar como en Knuth D se calcula
+// una vez x = mag_reciproco(d) y el dividendo se recorre en trozos de n
+// bloques desde arriba: cada paso divide (resto, trozo), de 2n bloques y
+// menor que d * BASE^n, con mag_divrem_reciproco.
+static void mag_divrem_newton(bg_limb *q, bg_limb *r, const bg_limb *a, size_t an,
+                              const bg_limb *d, size_t n) {
+    BG_CONTAR_NIVEL(BG_NIVEL_NEWTON);
+    size_t un = an + 1;
+    size_t k = (un + n - 1) / n;                    // trozos, el de arriba de h bloques
+    size_t h = un - (k - 1) * n;
+    size_t cap_u, cap_v, cap_x, cap_c, cap_b, cap_t, cap_r;
+    bg_limb *u = bg_trabajo_pedir(un, &cap_u);
+    bg_limb *v = bg_trabajo_pedir(n, &cap_v);
+    bg_limb *x = bg_trabajo_pedir(n + 1, &cap_x);
+    bg_limb *c = bg_trabajo_pedir(k * n, &cap_c);   // cociente completo
+    bg_limb *buf = bg_trabajo_pedir(2 * n, &cap_b);
+    bg_limb *qt = bg_trabajo_pedir(n + 1, &cap_t);
+    bg_limb *resto = bg_trabajo_pedir(n, &cap_r);
+
+    bg_limb f = (bg_limb)(BG_BASE / ((bg_dlimb)d[n - 1] + 1));
+    mag_mul_1(v, d, n, f);
+    u[an] = mag_mul_1(u, a, an, f);
+    mag_reciproco(x, v, n);
+
+    mag_divrem_reciproco(qt, resto, u + (k - 1) * n, h, v, n, x);
+    memcpy(c + (k - 1) * n, qt, n * sizeof(bg_limb));
+    for (size_t i = k - 1; i-- > 0; ) {
+        memcpy(buf, u + i * n, n * sizeof(bg_limb));
+        memcpy(buf + n, resto, n * sizeof(bg_limb));
+        mag_divrem_reciproco(qt, resto, buf, 2 * n, v, n, x);
+        memcpy(c + i * n, qt, n * sizeof(bg_limb));
+    }
+
+    memcpy(q, c, (an - n + 1) * sizeof(bg_limb));
+    mag_divrem_1(r, resto, n, f);                    // deshacer la normalización
+
+    bg_trabajo_devolver(resto, cap_r);
+    bg_trabajo_devolver(qt, cap_t);
+    bg_trabajo_devolver(buf, cap_b);
+    bg_trabajo_devolver(c, cap_c);
+    bg_trabajo_devolver(x, cap_x);
+    bg_trabajo_devolver(v, cap_v);
+    bg_trabajo_devolver(u, cap_u);
+}
+
+// q (an-n+1 bloques) = a / d y r (n bloques) = a mod d, con an >= n y
+// d[n-1] != 0. Elige divrem_1, Knuth D o Newton según n. Si el cociente
+// es mucho más corto que el divisor, los s bloques bajos de ambos apenas
+// influyen: el cociente de los bloques altos, con dos de guarda, se pasa
+// como mucho en uno o dos, y se corrige con el producto completo q*d.
+// Pide su memoria al ámbito temporal abierto.
+static void mag_divrem(bg_limb *q, bg_limb *r, const bg_limb *a, size_t an,
+                       const bg_limb *d, size_t n) {
+    size_t qn = an - n + 1;
+    if (n == 1) {
+        BG_CONTAR_NIVEL(BG_NIVEL_DIV_1);
+        r[0] = mag_divrem_1(q, a, an, d[0]);
+        return;
+    }
+    if (n < bg_umbral.div_newton) {
+        mag_divrem_knuth(q, r, a, an, d, n);
+        return;
+    }
+    if (qn + 2 >= n) {
+        mag_divrem_newton(q, r, a, an, d, n);
+        return;
+    }
+
+    size_t s = n - qn - 2;
+    size_t cap_r, cap_p;
+    bg_limb *r_alto = bg_trabajo_pedir(n - s, &cap_r);
+    mag_divrem(q, r_alto, a + s, an - s, d + s, n - s);
+    bg_trabajo_devolver(r_alto, cap_r);
+
+    size_t pn = qn + n;
+    bg_limb *p = bg_trabajo_pedir(pn, &cap_p);
+    mag_multiplicar(p, q, qn, d, n);
+    while (mag_comparar(p, pn, a, an) > 0) {
+        BG_CONTAR(correcciones_div, 1);
+        mag_restar(q, q, qn, (const bg_limb[]){1}, 1);
+        mag_restar(p, p, pn, d, n);
+    }
+    mag_restar(p, a, an, p, mag_normalizar(p, pn));  // a - q*d < d
+    memcpy(r, p, n * sizeof(bg_limb));
+    bg_trabajo_devolver(p, cap_p);
+}
+
+// División truncada: el cociente lleva el signo del producto de los
+// signos y el residuo el del dividendo
+static BigInt* dividir_largo_en_arena(const BigInt *dividendo, const BigInt *divisor, BigInt **residuo) {
+    if (bg_es_cero(divisor)) {
+        fprintf(stderr, "Error: División por cero\n");
+        exit(1);
+    }
+
+    size_t an = dividendo->longitud, n = divisor->longitud;
+    if (mag_comparar(dividendo->bloques, an, divisor->bloques, n) < 0) {
+        if (residuo) *residuo = bg_clone(dividendo);
+        return bg_cero();
+    }
+
+    size_t qn = an - n + 1;
+    BigInt *cociente = bg_nuevo();
+    BigInt *resto = bg_nuevo();
+    bg_crecer(cociente, qn);
+    bg_crecer(resto, n);
+    mag_divrem(cociente->bloques, resto->bloques, dividendo->bloques, an,
+               divisor->bloques, n);
+
+    cociente->signo = dividendo->signo * divisor->signo;
+    resto->signo = dividendo->signo;
+    bg_fijar_longitud(cociente, qn);
+    bg_fijar_longitud(resto, n);
+
+    if (residuo) {
+        *residuo = resto;
+    } else {
+        bg_liberar(resto);
+    }
+    return cociente;
+}
+
+// División larga: el espacio de trabajo sale de la arena temporal del
+// hilo; cociente y residuo se copian fuera antes de cerrar el ámbito.
+BigInt* bg_dividir_largo(const BigInt *dividendo, const BigInt *divisor, BigInt **residuo) {
+    BG_OP_INICIO();
+    BgArena *previa = bg_temporal_abrir();
+    BigInt *resto = NULL;
+    BigInt *c = dividir_largo_en_arena(dividendo, divisor, residuo ? &resto : NULL);
+    bg_arena_activar(previa);
+    BigInt *cociente = bg_clone(c);
+    if (residuo) *residuo = bg_clone(resto);
+    bg_temporal_cerrar(previa);
+    BG_OP_FIN(BG_OP_DIVIDIR);
+    return cociente;
+}
+
+// ---------------------------------------------------------------------
+// Operaciones de bits
+//
+// Trabajan sobre la representación binaria del valor. En las bases 2^64
+// y 2^32 los bloques ya son esas palabras y todo es lineal. En base 10^9
+// las operaciones lógicas, la longitud en bits y los bits sueltos pasan
+// por palabras de 32 bits con una conversión cuadrática, y los
+// desplazamientos multiplican o dividen por potencias de dos.
+//
+// Las operaciones lógicas siguen el complemento a dos con el signo
+// extendido a la izquierda (como GMP o Python); bg_popcount,
+// bg_bit_length y bg_test_bit miran |a|. bg_shr trunca hacia cero, igual
+// que bg_dividir_largo entre 2^k.
+// ---------------------------------------------------------------------
+
+#ifdef BG_DECIMAL
+#define BITS_DEC_PASO     29    // 2^29 < 10^9: mayor desplazamiento de un solo bloque
+#define BITS_DEC_PASOS    16    // por encima, multiplicar o dividir por 2^k
+
+// Palabras de 32 bits de la magnitud a (n bloques); w necesita n palabras.
+// Cuadrática: dos divisiones entre 2^16 por palabra.
+static size_t bits_a_palabras(bg_limb *w, const bg_limb *a, size_t n) {
+    size_t cap;
+    bg_limb *t = bg_trabajo_pedir(n, &cap);
+    memcpy(t, a, n * sizeof(bg_limb));
+    size_t tn = mag_normalizar(t, n), wn = 0;
+    while (tn > 1 || t[0] != 0) {
+        bg_limb bajo = mag_divrem_1(t, t, tn, 1u << 16);
+        bg_limb alto = mag_divrem_1(t, t, tn, 1u << 16);
+        w[wn++] = bajo | alto << 16;
+        tn = mag_normalizar(t, tn);
+    }
+    if (wn == 0) w[wn++] = 0;
+    bg_trabajo_devolver(t, cap);
+    return wn;
+}
+
+// Bloques decimales de wn palabras de 32 bits, por Horner de 16 en 16
+// bits; r necesita BITS_BLOQUES(wn) bloques (32 bits < 1.07 bloques)
+#define BITS_BLOQUES(wn) ((wn) + (wn) / 8 + 2)
+static size_t bits_desde_palabras(bg_limb *r, const bg_limb *w, size_t wn) {
+    size_t rn = 1;
+    r[0] = 0;
+    for (size_t i = wn; i-- > 0; ) {
+        for (int mitad = 1; mitad >= 0; mitad--) {
+            bg_limb c = mag_mul_1(r, r, rn, 1u << 16);
+            if (c) r[rn++] = c;
+            c = mag_incrementar(r, rn, (w[i] >> (16 * mitad)) & 0xFFFF);
+            if (c) r[rn++] = c;
+        }
+    }
+    return rn;
+}
+
+// dst *= 2^k o dst /= 2^k (truncando) de BITS_DEC_PASO en BITS_DEC_PASO bits
+static void bits_desplazar_dec(BigInt *dst, size_t k, int izquierda) {
+    while (k > 0) {
+        unsigned s = k < BITS_DEC_PASO ? (unsigned)k : BITS_DEC_PASO;
+        size_t n = dst->longitud;
+        if (izquierda) {
+            bg_crecer(dst, n + 1);
+            dst->bloques[n] = mag_mul_1(dst->bloques, dst->bloques, n, (bg_limb)1 << s);
+            bg_fijar_longitud(dst, n + 1);
+        } else {
+            mag_divrem_1(dst->bloques, dst->bloques, n, (bg_limb)1 << s);
+            bg_fijar_longitud(dst, n);
+        }
+        k -= s;
+    }
+}
+
+// p = 2^k, elevando al cuadrado desde el bit alto de k
+static void bits_potencia2(BigInt *p, size_t k) {
+    bg_crecer(p, 1);
+    p->bloques[0] = 1;
+    p->longitud = 1;
+    p->signo = 1;
+    for (int i = (int)(8 * sizeof(size_t)) - 1; i >= 0; i--) {
+        if (p->longitud > 1 || p->bloques[0] > 1) bg_square_into(p, p);
+        if ((k >> i) & 1) bits_desplazar_dec(p, 1, 1);
+    }
+}
+#endif
+
+// Palabras binarias de |a|: en las bases binarias los propios bloques
+// (cap = 0); en base 10^9 una copia convertida en el ámbito temporal
+static const bg_limb* bits_palabras(const BigInt *a, size_t *n, size_t *cap) {
+#ifdef BG_DECIMAL
+    bg_limb *w = bg_trabajo_pedir(a->longitud, cap);
+    *n = bits_a_palabras(w, a->bloques, a->longitud);
+    return w;
+#else
+    *cap = 0;
+    *n = a->longitud;
+    return a->bloques;
+#endif
+}
+
+static void bits_soltar(const bg_limb *w, size_t cap) {
+    if (cap) bg_trabajo_devolver((bg_limb *)w, cap);
+}
+
+// dst = signo * (valor de las wn palabras w); w no puede ser dst->bloques
+static void bits_fijar(BigInt *dst, const bg_limb *w, size_t wn, int signo) {
+#ifdef BG_DECIMAL
+    bg_crecer(dst, BITS_BLOQUES(wn));
+    size_t n = bits_desde_palabras(dst->bloques, w, wn);
+#else
+    bg_crecer(dst, wn);
+    memcpy(dst->bloques, w, wn * sizeof(bg_limb));
+    size_t n = wn;
+#endif
+    dst->signo = signo;
+    bg_fijar_longitud(dst, n);
+}
+
+// dst = a * 2^k, con el signo de a; dst puede ser a
+void bg_shl_into(BigInt *dst, const BigInt *a, size_t k) {
+#ifdef BG_DECIMAL
+    bg_copiar_en(dst, a);
+    if (k <= BITS_DEC_PASO * BITS_DEC_PASOS) {
+        bits_desplazar_dec(dst, k, 1);
+        return;
+    }
+    BgArena *previa = bg_temporal_abrir();
+    BigInt *p = bg_nuevo();
+    bits_potencia2(p, k);
+    bg_mul_into(dst, dst, p);
+    bg_liberar(p);
+    bg_temporal_cerrar(previa);
+#else
+    size_t w = k / BG_LIMB_BITS, n = a->longitud;
+    unsigned s = k % BG_LIMB_BITS;
+    if (n == 1 && a->bloques[0] == 0) {
+        bg_copiar_en(dst, a);
+        return;
+    }
+    bg_crecer(dst, n + w + 1);
+    // De arriba abajo: con dst == a cada bloque se lee antes de pisarlo
+    dst->bloques[n + w] = mag_lshift(dst->bloques + w, a->bloques, n, s);
+    memset(dst->bloques, 0, w * sizeof(bg_limb));
+    dst->signo = a->signo;
+    bg_fijar_longitud(dst, n + w + 1);
+#endif
+}
+
+// dst = a / 2^k truncando hacia cero; dst puede ser a
+void bg_shr_into(BigInt *dst, const BigInt *a, size_t k) {
+#ifdef BG_DECIMAL
+    bg_copiar_en(dst, a);
+    if (k <= BITS_DEC_PASO * BITS_DEC_PASOS) {
+        bits_desplazar_dec(dst, k, 0);
+        return;
+    }
+    BgArena *previa = bg_temporal_abrir();
+    BigInt *p = bg_nuevo();
+    bits_potencia2(p, k);
+    size_t n = dst->longitud;
+    if (p->longitud > n) {
+        dst->bloques[0] = 0;
+        bg_fijar_longitud(dst, 1);
+    } else {
+        size_t cap_q, cap_r;
+        bg_limb *q = bg_trabajo_pedir(n - p->longitud + 1, &cap_q);
+        bg_limb *r = bg_trabajo_pedir(p->longitud, &cap_r);
+        mag_divrem(q, r, dst->bloques, n, p->bloques, p->longitud);
+        memcpy(dst->bloques, q, (n - p->longitud + 1) * sizeof(bg_limb));
+        bg_fijar_longitud(dst, n - p->longitud + 1);
+        bg_trabajo_devolver(r, cap_r);
+        bg_trabajo_devolver(q, cap_q);
+    }
+    bg_liberar(p);
+    bg_temporal_cerrar(previa);
+#else
+    size_t w = k / BG_LIMB_BITS, n = a->longitud;
+    unsigned s = k % BG_LIMB_BITS;
+    if (w >= n) {
+        bg_crecer(dst, 1);
+        dst->bloques[0] = 0;
+        bg_fijar_longitud(dst, 1);
+        return;
+    }
+    bg_crecer(dst, n - w);
+    // De abajo arriba: con dst == a cada bloque se lee antes de pisarlo
+    mag_rshift(dst->bloques, a->bloques + w, n - w, s);
+    dst->signo = a->signo;
+    bg_fijar_longitud(dst, n - w);
+#endif
+}
+
+BigInt* bg_shl(const BigInt *a, size_t k) {
+    BigInt *r = bg_nuevo();
+    bg_shl_into(r, a, k);
+    return r;
+}
+
+BigInt* bg_shr(const BigInt *a, size_t k) {
+    BigInt *r = bg_nuevo();
+    bg_shr_into(r, a, k);
+    return r;
+}
+
+enum { BITS_AND, BITS_OR, BITS_XOR };
+
+static inline bg_limb bits_op(bg_limb x, bg_limb y, int op) {
+    return op == BITS_AND ? x & y : op == BITS_OR ? x | y : x ^ y;
+}
+
+// x (n palabras) = complemento a dos de x
+static void bits_negar(bg_limb *x, size_t n) {
+    size_t i = 0;
+    while (i < n && x[i] == 0) i++;
+    if (i == n) return;
+    x[i] = ~x[i] + 1;
+    for (i++; i < n; i++) x[i] = ~x[i];
+}
+
+// x (n palabras) = w (wn < n palabras) en complemento a dos con signo s
+static void bits_extender(bg_limb *x, const bg_limb *w, size_t wn, size_t n, int s) {
+    memcpy(x, w, wn * sizeof(bg_limb));
+    memset(x + wn, 0, (n - wn) * sizeof(bg_limb));
+    if (s < 0) bits_negar(x, n);
+}
+
+// dst = a op b en complemento a dos; dst puede ser a o b
+static void bits_logica(BigInt *dst, const BigInt *a, const BigInt *b, int op) {
+#ifndef BG_DECIMAL
+    if (a->signo > 0 && b->signo > 0) {
+        // Caso común sin complementos: una sola pasada sobre los bloques
+        const BigInt *largo = a->longitud >= b->longitud ? a : b;
+        const BigInt *corto = largo == a ? b : a;
+        size_t n = op == BITS_AND ? corto->longitud : largo->longitud;
+        size_t m = corto->longitud;
+        bg_crecer(dst, n);
+        const bg_limb *pl = largo->bloques, *pc = corto->bloques;
+        bg_limb *r = dst->bloques;
+        for (size_t i = 0; i < m; i++) r[i] = bits_op(pl[i], pc[i], op);
+        if (r != pl) memcpy(r + m, pl + m, (n - m) * sizeof(bg_limb));
+        dst->signo = 1;
+        bg_fijar_longitud(dst, n);
+        return;
+    }
+#endif
+    BgArena *previa = bg_temporal_abrir();
+    size_t an, bn, cap_a, cap_b, cap_x, cap_y;
+    const bg_limb *wa = bits_palabras(a, &an, &cap_a);
+    const bg_limb *wb = bits_palabras(b, &bn, &cap_b);
+    size_t n = (an > bn ? an : bn) + 1;
+    bg_limb *x = bg_trabajo_pedir(n, &cap_x);
+    bg_limb *y = bg_trabajo_pedir(n, &cap_y);
+    bits_extender(x, wa, an, n, a->signo);
+    bits_extender(y, wb, bn, n, b->signo);
+    for (size_t i = 0; i < n; i++) x[i] = bits_op(x[i], y[i], op);
+    int signo = x[n - 1] >> (BG_LIMB_BITS - 1) ? -1 : 1;
+    if (signo < 0) bits_negar(x, n);
+    bits_fijar(dst, x, n, signo);
+    bg_trabajo_devolver(y, cap_y);
+    bg_trabajo_devolver(x, cap_x);
+    bits_soltar(wb, cap_b);
+    bits_soltar(wa, cap_a);
+    bg_temporal_cerrar(previa);
+}
+
+void bg_and_into(BigInt *dst, const BigInt *a, const BigInt *b) { bits_logica(dst, a, b, BITS_AND); }
+void bg_or_into(BigInt *dst, const BigInt *a, const BigInt *b)  { bits_logica(dst, a, b, BITS_OR); }
+void bg_xor_into(BigInt *dst, const BigInt *a, const BigInt *b) { bits_logica(dst, a, b, BITS_XOR); }
+
+// Bits del valor de un doble bloque
+static unsigned bits_doble(bg_dlimb t) {
+    bg_limb alto = (bg_limb)(t >> BG_LIMB_BITS);
+    return alto ? 2 * BG_LIMB_BITS - BG_CLZ(alto)
+                : (bg_limb)t ? BG_LIMB_BITS - BG_CLZ((bg_limb)t) : 0;
+}
+
+// Número de bits de |a|; 0 para el cero
+size_t bg_bit_length(const BigInt *a) {
+    BgArena *previa = bg_temporal_abrir();
+    size_t n, cap;
+    const bg_limb *w = bits_palabras(a, &n, &cap);
+    size_t bits = w[n - 1] ? n * BG_LIMB_BITS - BG_CLZ(w[n - 1]) : 0;
+    bits_soltar(w, cap);
+    bg_temporal_cerrar(previa);
+    return bits;
+}
+
+// Bits encendidos de |a|
+size_t bg_popcount(const BigInt *a) {
+    BgArena *previa = bg_temporal_abrir();
+    size_t n, cap, total = 0;
+    const bg_limb *w = bits_palabras(a, &n, &cap);
+    for (size_t i = 0; i < n; i++) total += BG_POPCOUNT(w[i]);
+    bits_soltar(w, cap);
+    bg_temporal_cerrar(previa);
+    return total;
+}
+
+// Bit i de |a|
+int bg_test_bit(const BigInt *a, size_t i) {
+    BgArena *previa = bg_temporal_abrir();
+    size_t n, cap;
+    const bg_limb *w = bits_palabras(a, &n, &cap);
+    size_t j = i / BG_LIMB_BITS;
+    int bit = j < n ? (int)((w[j] >> (i % BG_LIMB_BITS)) & 1) : 0;
+    bits_soltar(w, cap);
+    bg_temporal_cerrar(previa);
+    return bit;
+}
+
+// División binaria por corrimientos y restas sucesivas: con t = |d| << s
+// alineado con el bit alto de |a|, en cada paso el cociente se duplica,
+// se resta t del resto si cabe (sumando 1 al cociente) y t se divide
+// entre 2. Cuesta O(bits * n), cuadrática como la escolar pero con un
+// bit de cociente por paso; bg_dividir_largo es la opción rápida. Mismos
+// signos que bg_dividir_largo.
+BigInt* bg_dividir_binario(const BigInt *dividendo, const BigInt *divisor, BigInt **residuo) {
+    if (bg_es_cero(divisor)) {
+        fprintf(stderr, "Error: División por cero\n");
+        exit(1);
+    }
+    BigInt *cociente = bg_nuevo();
+    BigInt *resto = bg_clone(dividendo);
+    BigInt vd = *divisor;
+    vd.signo = 1;
+    size_t ba = bg_bit_length(dividendo), bd = bg_bit_length(divisor);
+
+    if (ba < bd) {
+        bg_crecer(cociente, 1);
+        cociente->bloques[0] = 0;
+        bg_fijar_longitud(cociente, 1);
+    } else {
+        BgArena *previa = bg_temporal_abrir();
+        size_t s = ba - bd;
+        BigInt *t = bg_shl(&vd, s);
+#ifdef BG_DECIMAL
+        size_t qn = s / BITS_DEC_PASO + 2;                  // más de 29 bits por bloque
+#else
+        size_t qn = s / BG_LIMB_BITS + 2;
+#endif
+        bg_crecer(cociente, qn);
+        memset(cociente->bloques, 0, qn * sizeof(bg_limb));
+        bg_limb *q = cociente->bloques, *r = resto->bloques;
+        size_t rn = resto->longitud;
+
+        for (size_t i = s + 1; i-- > 0; ) {
+            mag_sumar(q, q, qn, q, qn);                     // q *= 2
+            if (mag_comparar(r, rn, t->bloques, t->longitud) >= 0) {
+                mag_restar(r, r, rn, t->bloques, t->longitud);
+                rn = mag_normalizar(r, rn);
+                q[0] += 1;                                  // q es par
+            }
+#ifdef BG_DECIMAL
+            mag_divrem_1(t->bloques, t->bloques, t->longitud, 2);
+#else
+            mag_rshift(t->bloques, t->bloques, t->longitud, 1);
+#endif
+            t->longitud = mag_normalizar(t->bloques, t->longitud);
+        }
+        bg_liberar(t);
+        bg_temporal_cerrar(previa);
+        cociente->signo = dividendo->signo * divisor->signo;
+        bg_fijar_longitud(cociente, qn);
+        bg_fijar_longitud(resto, rn);
+    }
+
+    if (residuo) {
+        *residuo = resto;
+    } else {
+        bg_liberar(resto);
+    }
+    return cociente;
+}
+
+// ---------------------------------------------------------------------
+// Aritmética modular
+//
+// Un BgModulo guarda lo que cuesta preparar para un módulo m y se reusa
+// en todas las operaciones con ese m. Los restos se guardan como n
+// bloques, los de m, y los productos de 2n bloques se reducen de una de
+// dos maneras:
+//   Montgomery: si m es primo con la base (impar en base 2^k, ni par ni
+//     múltiplo de 5 en base 10^9), los restos viven multiplicados por
+//     R = BASE^n y REDC anula un bloque bajo por paso con mag_addmul_1,
+//     sin divisiones. Cuadrática: solo compensa por debajo de
+//     MODULAR_REDC_UMBRAL bloques.
+//   Recíproco (Barrett): m se normaliza como en Knuth D y el producto se
+//     divide con mag_divrem_reciproco y el recíproco de Newton calculado
+//     una vez; son dos multiplicaciones de n bloques.
+// bg_powmod_into usa ventana deslizante: potencias impares g, g^3, ...,
+// g^(2^k - 1) y un producto por ventana en lugar de uno por bit. Los
+// bits del exponente se leen una vez con bits_palabras, que en base 10^9
+// es la única conversión.
+// ---------------------------------------------------------------------
+
+#ifndef MODULAR_REDC_UMBRAL
+#define MODULAR_REDC_UMBRAL 24   // bloques del módulo
+#endif
+
+BgModulo* bg_modulo_nuevo(const BigInt *m) {
+    if (bg_es_cero(m)) {
+        fprintf(stderr, "Error: Módulo cero\n");
+        exit(1);
+    }
+    size_t n = m->longitud;
+    BgModulo *md = calloc(1, sizeof(BgModulo));
+    md->n = n;
+    md->m = malloc(n * sizeof(bg_limb));
+    memcpy(md->m, m->bloques, n * sizeof(bg_limb));
+
+#ifdef BG_DECIMAL
+    int coprimo = md->m[0] % 2 != 0 && md->m[0] % 5 != 0;
+#else
+    int coprimo = md->m[0] & 1;
+#endif
+    md->montgomery = coprimo && n < MODULAR_REDC_UMBRAL;
+
+    BgArena *previa = bg_temporal_abrir();
+    if (md->montgomery) {
+        // m0^-1 mod BASE por Newton: x(2 - m0*x) dobla las cifras correctas
+        bg_limb m0 = md->m[0], x = 1;
+#ifdef BG_DECIMAL
+        while ((bg_dlimb)m0 * x % 10 != 1) x++;
+#endif
+        for (int i = 0; i < 6; i++)
+            x = BG_BAJO((bg_dlimb)x * BG_BAJO(BG_BASE + 2 - BG_BAJO((bg_dlimb)m0 * x)));
+        md->minv = x ? (bg_limb)(BG_BASE - x) : 0;
+
+        // r2 = BASE^(2n) mod m
+        size_t cap_p, cap_q;
+        bg_limb *p = bg_trabajo_pedir(2 * n + 1, &cap_p);
+        bg_limb *q = bg_trabajo_pedir(n + 2, &cap_q);
+        memset(p, 0, 2 * n * sizeof(bg_limb));
+        p[2 * n] = 1;
+        md->r2 = malloc(n * sizeof(bg_limb));
+        mag_divrem(q, md->r2, p, 2 * n + 1, md->m, n);
+        bg_trabajo_devolver(q, cap_q);
+        bg_trabajo_devolver(p, cap_p);
+    } else {
+        md->f = (bg_limb)(BG_BASE / ((bg_dlimb)md->m[n - 1] + 1));
+        md->v = malloc(n * sizeof(bg_limb));
+        md->x = malloc((n + 1) * sizeof(bg_limb));
+        mag_mul_1(md->v, md->m, n, md->f);
+        mag_reciproco(md->x, md->v, n);
+    }
+    bg_temporal_cerrar(previa);
+    return md;
+}
+
+void bg_modulo_liberar(BgModulo *md) {
+    free(md->m);
+    free(md->r2);
+    free(md->v);
+    free(md->x);
+    free(md);
+}
+
+// r (n bloques) = t mod m en la forma del módulo: t * R^-1 con Montgomery,
+// t con el recíproco. t tiene 2n bloques, vale menos que m * BASE^n y se
+// sobrescribe.
+static void mod_reducir(const BgModulo *md, bg_limb *r, bg_limb *t) {
+    size_t n = md->n;
+    if (md->montgomery) {
+        // Cada paso suma q*m*BASE^i con q elegido para anular t[i]
+        bg_limb alto = 0;
+        for (size_t i = 0; i < n; i++) {
+            bg_limb q = BG_BAJO((bg_dlimb)t[i] * md->minv);
+            bg_limb acarreo = mag_addmul_1(t + i, md->m, n, q);
+            alto += mag_incrementar(t + i + n, n - i, acarreo);
+        }
+        // t / R < 2m
+        if (alto || mag_comparar(t + n, n, md->m, n) >= 0)
+            mag_restar(t + n, t + n, n, md->m, n);
+        memcpy(r, t + n, n * sizeof(bg_limb));
+        return;
+    }
+
+    // f*t < f*m*BASE^n <= BASE^(2n): cabe en los 2n bloques
+    size_t cap_q, cap_r;
+    bg_limb *q = bg_trabajo_pedir(n + 1, &cap_q);
+    bg_limb *resto = bg_trabajo_pedir(n, &cap_r);
+    mag_mul_1(t, t, 2 * n, md->f);
+    mag_divrem_reciproco(q, resto, t, 2 * n, md->v, n, md->x);
+    mag_divrem_1(r, resto, n, md->f);                // deshacer la normalización
+    bg_trabajo_devolver(resto, cap_r);
+    bg_trabajo_devolver(q, cap_q);
+}
+
+// r = a * b en la forma del módulo; t es espacio para 2n bloques
+static void mod_mul(const BgModulo *md, bg_limb *r, const bg_limb *a, const bg_limb *b,
+                    bg_limb *t) {
+    size_t n = md->n;
+    mag_multiplicar(t, a, n, b, n);
+    mod_reducir(md, r, t);
+}
+
+// r (n bloques) = a mod m en [0, m), para a de cualquier signo y tamaño
+static void mod_desde(const BgModulo *md, bg_limb *r, const BigInt *a) {
+    size_t n = md->n, an = a->longitud;
+    if (mag_comparar(a->bloques, an, md->m, n) < 0) {
+        memcpy(r, a->bloques, an * sizeof(bg_limb));
+        memset(r + an, 0, (n - an) * sizeof(bg_limb));
+    } else {
+        size_t cap;
+        bg_limb *q = bg_trabajo_pedir(an - n + 1, &cap);
+        mag_divrem(q, r, a->bloques, an, md->m, n);
+        bg_trabajo_devolver(q, cap);
+    }
+    if (a->signo < 0 && (mag_normalizar(r, n) > 1 || r[0] != 0))
+        mag_restar(r, md->m, n, r, n);
+}
+
+// Pasa r (en [0, m)) a la forma del módulo: r * R mod m con Montgomery
+static void mod_entrar(const BgModulo *md, bg_limb *r, bg_limb *t) {
+    if (md->montgomery) mod_mul(md, r, r, md->r2, t);
+}
+
+// Deshace mod_entrar: r * R^-1 mod m con Montgomery
+static void mod_salir(const BgModulo *md, bg_limb *r, bg_limb *t) {
+    if (!md->montgomery) return;
+    size_t n = md->n;
+    memcpy(t, r, n * sizeof(bg_limb));
+    memset(t + n, 0, n * sizeof(bg_limb));
+    mod_reducir(md, r, t);
+}
+
+static void mod_fijar(BigInt *dst, const bg_limb *r, size_t n) {
+    bg_crecer(dst, n);
+    memcpy(dst->bloques, r, n * sizeof(bg_limb));
+    dst->signo = +1;
+    bg_fijar_longitud(dst, n);
+}
+
+// dst = a * b mod m, en [0, m); dst puede ser a o b
+void bg_mulmod_into(BigInt *dst, const BigInt *a, const BigInt *b, const BgModulo *md) {
+    size_t n = md->n;
+    BgArena *previa = bg_temporal_abrir();
+    size_t cap_a, cap_b, cap_t;
+    bg_limb *ra = bg_trabajo_pedir(n, &cap_a);
+    bg_limb *rb = bg_trabajo_pedir(n, &cap_b);
+    bg_limb *t = bg_trabajo_pedir(2 * n, &cap_t);
+    mod_desde(md, ra, a);
+    mod_desde(md, rb, b);
+    mod_entrar(md, ra, t);                       // aR * b * R^-1 = ab
+    mod_mul(md, ra, ra, rb, t);
+    mod_fijar(dst, ra, n);
+    bg_trabajo_devolver(t, cap_t);
+    bg_trabajo_devolver(rb, cap_b);
+    bg_trabajo_devolver(ra, cap_a);
+    bg_temporal_cerrar(previa);
+}
+
+// Bits de ventana para un exponente de bits bits: el que minimiza
+// tabla + productos, 2^(k-1) + bits/(k+1)
+static int mod_ventana(size_t bits) {
+    static const size_t limites[] = { 7, 25, 81, 241, 673, 1793, 4609 };
+    int k = 1;
+    while (k <= 7 && bits > limites[k - 1]) k++;
+    return k;
+}
+
+static int mod_bit(const bg_limb *w, size_t i) {
+    return (int)((w[i / BG_LIMB_BITS] >> (i % BG_LIMB_BITS)) & 1);
+}
+
+// dst = base^e mod m, en [0, m), con e >= 0; dst puede ser base o e
+void bg_powmod_into(BigInt *dst, const BigInt *base, const BigInt *e, const BgModulo *md) {
+    if (e->signo < 0 && !bg_es_cero(e)) {
+        fprintf(stderr, "Error: Exponente negativo en bg_powmod\n");
+        exit(1);
+    }
+    BG_OP_INICIO();
+    size_t n = md->n;
+    BgArena *previa = bg_temporal_abrir();
+    size_t wn, cap_w, cap_r, cap_t, cap_g;
+    const bg_limb *w = bits_palabras(e, &wn, &cap_w);
+    size_t bits = w[wn - 1] ? wn * BG_LIMB_BITS - BG_CLZ(w[wn - 1]) : 0;
+    bg_limb *r = bg_trabajo_pedir(n, &cap_r);
+    bg_limb *t = bg_trabajo_pedir(2 * n, &cap_t);
+
+    if (bits == 0) {
+        memset(r, 0, n * sizeof(bg_limb));
+        r[0] = n > 1 || md->m[0] > 1;            // 1 mod m
+    } else {
+        // tabla[j] = g^(2j+1), y g^2 para pasar de una a otra
+        int k = mod_ventana(bits);
+        size_t entradas = (size_t)1 << (k - 1);
+        bg_limb *tabla = bg_trabajo_pedir((entradas + 1) * n, &cap_g);
+        bg_limb *g2 = tabla + entradas * n;
+        mod_desde(md, tabla, base);
+        mod_entrar(md, tabla, t);
+        mod_mul(md, g2, tabla, tabla, t);
+        for (size_t j = 1; j < entradas; j++)
+            mod_mul(md, tabla + j * n, tabla + (j - 1) * n, g2, t);
+
+        // Del bit alto al bajo: los ceros cuestan un cuadrado; una ventana
+        // de hasta k bits que empieza y acaba en uno, sus cuadrados y un
+        // producto por la potencia impar de la tabla
+        int primero = 1;
+        size_t i = bits;
+        while (i > 0) {
+            if (!mod_bit(w, i - 1)) {
+                mod_mul(md, r, r, r, t);
+                i--;
+                continue;
+            }
+            size_t l = i > (size_t)k ? i - k : 0;
+            while (!mod_bit(w, l)) l++;
+            size_t valor = 0;
+            for (size_t j = i; j-- > l; ) valor = 2 * valor + mod_bit(w, j);
+            const bg_limb *p = tabla + (valor / 2) * n;
+            if (primero) {
+                memcpy(r, p, n * sizeof(bg_limb));
+                primero = 0;
+            } else {
+                for (size_t j = l; j < i; j++) mod_mul(md, r, r, r, t);
+                mod_mul(md, r, r, p, t);
+            }
+            i = l;
+        }
+        mod_salir(md, r, t);
+        bg_trabajo_devolver(tabla, cap_g);
+    }
+
+    bits_soltar(w, cap_w);
+    mod_fijar(dst, r, n);
+    bg_trabajo_devolver(t, cap_t);
+    bg_trabajo_devolver(r, cap_r);
+    bg_temporal_cerrar(previa);
+    BG_OP_FIN(BG_OP_POTMOD);
+}
+
+// base^e mod |m| en un BigInt nuevo; para muchas operaciones con el mismo
+// módulo, mejor un BgModulo y bg_powmod_into
+BigInt* bg_powmod(const BigInt *base, const BigInt *e, const BigInt *m) {
+    BgModulo *md = bg_modulo_nuevo(m);
+    BigInt *r = bg_nuevo();
+    bg_powmod_into(r, base, e, md);
+    bg_modulo_liberar(md);
+    return r;
+}
+
+// ---------------------------------------------------------------------
+// Máximo común divisor
+//
+// bg_gcd y bg_gcdext eligen el algoritmo por el tamaño:
+//   - Con dos bloques o menos, gcd binario sobre un doble bloque.
+//   - Lehmer (Knuth, algoritmo L): los cocientes de Euclides se sacan de
+//     los GCD_LEHMER_BITS bits altos de a y b mientras las dos cotas del
+//     cociente coincidan; la matriz, de entradas de un bloque, se aplica
+//     a los números completos con mag_mul_1 y mag_submul_1.
+//   - Desde GCD_HGCD_UMBRAL bloques, medio gcd: la matriz que reduce los
+//     bloques altos a la mitad vale también para los números completos,
+//     así que se calcula recursivamente sobre la mitad alta y se aplica
+//     con la multiplicación rápida (Möller, "On Schönhage's algorithm
+//     and subquadratic integer gcd computation").
+// Las matrices M = [m00 m01; m10 m11] tienen entradas >= 0 y determinante
+// det = +-1, y cumplen (a; b) = M (a'; b') con (a', b') los restos
+// actuales. Al final a = m00 g y b = m10 g, y g = det (m11 a - m01 b) da
+// los cofactores de bg_gcdext. Todo mira solo los bloques altos, así que
+// vale igual en base 10^9.
+// ---------------------------------------------------------------------
+
+#ifndef GCD_HGCD_UMBRAL
+#define GCD_HGCD_UMBRAL 160   // bloques
+#endif
+#define GCD_LEHMER_BITS (BG_LIMB_BITS - 3)   // |x + A| cabe en int64_t
+
+typedef struct {
+    BigInt *m[4];         // m00 m01 m10 m11
+    int det;
+} GcdMatriz;
+
+static void gcd_matriz_iniciar(GcdMatriz *M) {
+    M->m[0] = bg_uno();
+    M->m[1] = bg_cero();
+    M->m[2] = bg_cero();
+    M->m[3] = bg_uno();
+    M->det = 1;
+}
+
+static void gcd_matriz_liberar(GcdMatriz *M) {
+    for (int i = 0; i < 4; i++) bg_liberar(M->m[i]);
+}
+
+static int gcd_matriz_identidad(const GcdMatriz *M) {
+    return bg_es_cero(M->m[1]) && bg_es_cero(M->m[2]);
+}
+
+// M = M [q 1; 1 0]: la columna 0 pasa a m0 q + m1 y la 1 a la antigua 0
+static void gcd_matriz_paso(GcdMatriz *M, const BigInt *q) {
+    for (int f = 0; f < 4; f += 2) {
+        if (q->longitud == 1) {
+            bg_addmul_word_into(M->m[f + 1], M->m[f], q->bloques[0]);
+        } else {
+            BigInt *t = bg_nuevo();
+            bg_mul_into(t, M->m[f], q);
+            sumar_en(M->m[f + 1], M->m[f + 1], t, +1);
+            bg_liberar(t);
+        }
+        BigInt *t = M->m[f];
+        M->m[f] = M->m[f + 1];
+        M->m[f + 1] = t;
+    }
+    M->det = -M->det;
+}
+
+// M = M W, con W de entradas de un bloque y determinante det
+static void gcd_matriz_por_palabras(GcdMatriz *M, const bg_limb w[4], int det) {
+    for (int f = 0; f < 4; f += 2) {
+        BigInt *c0 = bg_cero(), *c1 = bg_cero();
+        bg_addmul_word_into(c0, M->m[f], w[0]);
+        bg_addmul_word_into(c0, M->m[f + 1], w[2]);
+        bg_addmul_word_into(c1, M->m[f], w[1]);
+        bg_addmul_word_into(c1, M->m[f + 1], w[3]);
+        bg_liberar(M->m[f]);
+        bg_liberar(M->m[f + 1]);
+        M->m[f] = c0;
+        M->m[f + 1] = c1;
+    }
+    M->det *= det;
+}
+
+// M = M N
+static void gcd_matriz_mul(GcdMatriz *M, const GcdMatriz *N) {
+    BigInt *t = bg_nuevo();
+    for (int f = 0; f < 4; f += 2) {
+        BigInt *c0 = bg_nuevo(), *c1 = bg_nuevo();
+        bg_mul_into(c0, M->m[f], N->m[0]);
+        bg_mul_into(t, M->m[f + 1], N->m[2]);
+        sumar_en(c0, c0, t, +1);
+        bg_mul_into(c1, M->m[f], N->m[1]);
+        bg_mul_into(t, M->m[f + 1], N->m[3]);
+        sumar_en(c1, c1, t, +1);
+        bg_liberar(M->m[f]);
+        bg_liberar(M->m[f + 1]);
+        M->m[f] = c0;
+        M->m[f + 1] = c1;
+    }
+    bg_liberar(t);
+    M->det *= N->det;
+}
+
+// Intercambia los valores de dos BigInt de la misma arena
+static void gcd_intercambiar(BigInt *a, BigInt *b) {
+    BigInt t = *a;
+    *a = *b;
+    *b = t;
+}
+
+// ¿x < BASE^s? Con s = 0, ¿x = 0?
+static int gcd_menor(const BigInt *x, size_t s) {
+    return s == 0 ? bg_es_cero(x) : x->longitud <= s;
+}
+
+// Un paso de Euclides, (a, b) = (b, a mod b) y M = M [q 1; 1 0], salvo
+// que s > 0 y el resto quede por debajo de BASE^s: entonces no cambia
+// nada y devuelve 0. b no es cero; si a < b el paso solo los intercambia.
+static int gcd_division(BigInt *a, BigInt *b, GcdMatriz *M, size_t s) {
+    size_t an = a->longitud, bn = b->longitud;
+    BigInt *q = bg_cero(), *r = bg_nuevo();
+    if (mag_comparar(a->bloques, an, b->bloques, bn) < 0) {
+        bg_copiar_en(r, a);
+    } else {
+        bg_crecer(q, an - bn + 1);
+        bg_crecer(r, bn);
+        mag_divrem(q->bloques, r->bloques, a->bloques, an, b->bloques, bn);
+        bg_fijar_longitud(q, an - bn + 1);
+        bg_fijar_longitud(r, bn);
+    }
+    int avanza = s == 0 || !gcd_menor(r, s);
+    if (avanza) {
+        gcd_intercambiar(a, b);
+        gcd_intercambiar(b, r);
+        if (M) gcd_matriz_paso(M, q);
+    }
+    bg_liberar(q);
+    bg_liberar(r);
+    return avanza;
+}
+
+static unsigned gcd_ctz(bg_dlimb x) {
+    bg_limb bajo = (bg_limb)x;
+    return bajo ? BG_CTZ(bajo) : BG_LIMB_BITS + BG_CTZ((bg_limb)(x >> BG_LIMB_BITS));
+}
+
+// gcd binario (Stein) de dos dobles bloques
+static bg_dlimb gcd_binario(bg_dlimb u, bg_dlimb v) {
+    if (u == 0) return v;
+    if (v == 0) return u;
+    unsigned k = gcd_ctz(u | v);
+    u >>= gcd_ctz(u);
+    do {
+        v >>= gcd_ctz(v);
+        if (u > v) {
+            bg_dlimb t = u;
+            u = v;
+            v = t;
+        }
+        v -= u;
+    } while (v);
+    return u << k;
+}
+
+// Valor de los dos bloques altos de a tomados en las posiciones n-1 y n-2
+static bg_dlimb gcd_alto_doble(const BigInt *a, size_t n) {
+    bg_limb alto = n - 1 < a->longitud ? a->bloques[n - 1] : 0;
+    bg_limb bajo = n - 2 < a->longitud ? a->bloques[n - 2] : 0;
+    return BG_JUNTAR(alto, bajo);
+}
+
+// Algoritmo L de Knuth sobre x = floor(a / D), y = floor(b / D), con D
+// tal que x e y caben en GCD_LEHMER_BITS bits. Un cociente vale para a y
+// b si las cotas (x + A) / (y + C) y (x + B) / (y + D) coinciden; tras k
+// pasos a' = A a + B b y b' = C a + D b. Deja w = {A, B, C, D} y
+// devuelve k. n = max(bloques de a, bloques de b) >= 2.
+static int gcd_lehmer_matriz(const BigInt *a, const BigInt *b, size_t n, int64_t w[4]) {
+    bg_dlimb ta = gcd_alto_doble(a, n), tb = gcd_alto_doble(b, n);
+    unsigned bits = bits_doble(ta > tb ? ta : tb);
+    unsigned corte = bits > GCD_LEHMER_BITS ? bits - GCD_LEHMER_BITS : 0;
+    int64_t x = (int64_t)(ta >> corte), y = (int64_t)(tb >> corte);
+    int64_t A = 1, B = 0, C = 0, D = 1;
+    int k = 0;
+    while (y + C > 0 && y + D > 0) {
+        int64_t q = (x + A) / (y + C);
+        if (q != (x + B) / (y + D)) break;
+        int64_t t = A - q * C; A = C; C = t;
+        t = B - q * D; B = D; D = t;
+        t = x - q * y; x = y; y = t;
+        k++;
+    }
+    w[0] = A; w[1] = B; w[2] = C; w[3] = D;
+    return k;
+}
+
+// r = x a + y b (n bloques), con x e y de signos opuestos y r >= 0
+static void gcd_combinar(bg_limb *r, const bg_limb *a, const bg_limb *b, size_t n,
+                         int64_t x, int64_t y) {
+    if (y <= 0) {
+        mag_mul_1(r, a, n, (bg_limb)x);
+        mag_submul_1(r, b, n, (bg_limb)-y);
+    } else {
+        mag_mul_1(r, b, n, (bg_limb)y);
+        mag_submul_1(r, a, n, (bg_limb)-x);
+    }
+}
+
+// Euclides con pasos de Lehmer sobre (a, b), acumulando en M si no es
+// NULL. Con s = 0 llega a b = 0 y deja el gcd en a; con s > 0 se para
+// antes del primer resto menor que BASE^s. Una matriz de Lehmer que se
+// pasa de BASE^s se descarta y el resto se hace con divisiones exactas.
+static void gcd_lehmer(BigInt *a, BigInt *b, GcdMatriz *M, size_t s) {
+    int exacto = 0;
+    while (!bg_es_cero(b)) {
+        size_t n = a->longitud > b->longitud ? a->longitud : b->longitud;
+        if (!M && n <= 2) {
+            bg_dlimb g = gcd_binario(gcd_alto_doble(a, 2), gcd_alto_doble(b, 2));
+            bg_crecer(a, 2);
+            a->bloques[0] = BG_BAJO(g);
+            a->bloques[1] = BG_ALTO(g);
+            bg_fijar_longitud(a, 2);
+            b->bloques[0] = 0;
+            b->longitud = 1;
+            return;
+        }
+
+        int64_t w[4];
+        int k = !exacto && n >= 2 ? gcd_lehmer_matriz(a, b, n, w) : 0;
+        if (k > 0) {
+            bg_crecer(a, n);
+            bg_crecer(b, n);
+            memset(a->bloques + a->longitud, 0, (n - a->longitud) * sizeof(bg_limb));
+            memset(b->bloques + b->longitud, 0, (n - b->longitud) * sizeof(bg_limb));
+            size_t cap_x, cap_y;
+            bg_limb *x = bg_trabajo_pedir(n, &cap_x);
+            bg_limb *y = bg_trabajo_pedir(n, &cap_y);
+            gcd_combinar(x, a->bloques, b->bloques, n, w[0], w[1]);
+            gcd_combinar(y, a->bloques, b->bloques, n, w[2], w[3]);
+            size_t xn = mag_normalizar(x, n), yn = mag_normalizar(y, n);
+            int vale = s == 0 || (xn > s && yn > s);
+            if (vale) {
+                memcpy(a->bloques, x, xn * sizeof(bg_limb));
+                memcpy(b->bloques, y, yn * sizeof(bg_limb));
+                bg_fijar_longitud(a, xn);
+                bg_fijar_longitud(b, yn);
+                if (M) {
+                    // (a; b) = [|D| |B|; |C| |A|] (a'; b'), un cambio de signo por paso
+                    static const int orden[4] = { 3, 1, 2, 0 };
+                    bg_limb wm[4];
+                    for (int i = 0; i < 4; i++) {
+                        int64_t v = w[orden[i]];
+                        wm[i] = (bg_limb)(v < 0 ? -v : v);
+                    }
+                    gcd_matriz_por_palabras(M, wm, k % 2 ? -1 : 1);
+                }
+            }
+            bg_trabajo_devolver(y, cap_y);
+            bg_trabajo_devolver(x, cap_x);
+            if (vale) continue;
+            exacto = 1;
+        }
+        if (!gcd_division(a, b, M, s)) return;
+    }
+}
+
+// alto = a div BASE^k y bajo = a mod BASE^k
+static void gcd_partir(BigInt *alto, BigInt *bajo, const BigInt *a, size_t k) {
+    size_t n = a->longitud;
+    if (k >= n) {
+        bg_copiar_en(bajo, a);
+        bg_crecer(alto, 1);
+        alto->bloques[0] = 0;
+        alto->longitud = 1;
+        alto->signo = +1;
+        return;
+    }
+    bg_crecer(alto, n - k);
+    memcpy(alto->bloques, a->bloques + k, (n - k) * sizeof(bg_limb));
+    alto->signo = +1;
+    bg_fijar_longitud(alto, n - k);
+    bg_crecer(bajo, k);
+    memcpy(bajo->bloques, a->bloques, k * sizeof(bg_limb));
+    bajo->signo = +1;
+    bg_fijar_longitud(bajo, k);
+}
+
+// dst = alto BASE^k + signo z; el resultado es >= 0
+static void gcd_juntar(BigInt *dst, const BigInt *alto, size_t k, const BigInt *z, int signo) {
+    size_t n = alto->longitud + k;
+    bg_crecer(dst, n);
+    memset(dst->bloques, 0, k * sizeof(bg_limb));
+    memcpy(dst->bloques + k, alto->bloques, alto->longitud * sizeof(bg_limb));
+    dst->signo = +1;
+    bg_fijar_longitud(dst, n);
+    sumar_en(dst, dst, z, signo * z->signo);
+}
+
+static void gcd_hgcd(BigInt *a, BigInt *b, GcdMatriz *M);
+
+// Medio gcd de los bloques de a y b desde k: con la matriz N que reduce
+// (a1, b1) = (a div BASE^k, b div BASE^k) a (a1', b1'),
+//   a' = a1' BASE^k + det (n11 a0 - n01 b0)
+//   b' = b1' BASE^k + det (n00 b0 - n10 a0)
+// con a0, b0 los k bloques bajos; así los productos son de la mitad del
+// tamaño. Acumula N en M.
+static void gcd_hgcd_alto(BigInt *a, BigInt *b, size_t k, GcdMatriz *M) {
+    BigInt *a1 = bg_nuevo(), *a0 = bg_nuevo(), *b1 = bg_nuevo(), *b0 = bg_nuevo();
+    gcd_partir(a1, a0, a, k);
+    gcd_partir(b1, b0, b, k);
+    GcdMatriz N;
+    gcd_matriz_iniciar(&N);
+    gcd_hgcd(a1, b1, &N);
+    if (!gcd_matriz_identidad(&N)) {
+        BigInt *x = bg_nuevo(), *t = bg_nuevo();
+        bg_mul_into(x, N.m[3], a0);
+        bg_mul_into(t, N.m[1], b0);
+        sumar_en(x, x, t, -1);
+        gcd_juntar(a, a1, k, x, N.det);
+        bg_mul_into(x, N.m[0], b0);
+        bg_mul_into(t, N.m[2], a0);
+        sumar_en(x, x, t, -1);
+        gcd_juntar(b, b1, k, x, N.det);
+        gcd_matriz_mul(M, &N);
+        bg_liberar(x);
+        bg_liberar(t);
+    }
+    gcd_matriz_liberar(&N);
+    bg_liberar(a1); bg_liberar(a0); bg_liberar(b1); bg_liberar(b0);
+}
+
+// Medio gcd: con n = max(bloques de a, bloques de b) y s = n/2 + 1,
+// reduce (a, b) mientras los dos queden por encima de BASE^s y acumula
+// la matriz en M. Las entradas de la matriz quedan por debajo de
+// BASE^(n-s) < BASE^s, y por eso la matriz de los bloques altos sirve
+// para los números completos: el error de los bloques bajos no alcanza
+// para cambiar el signo de los restos.
+static void gcd_hgcd(BigInt *a, BigInt *b, GcdMatriz *M) {
+    size_t n = a->longitud > b->longitud ? a->longitud : b->longitud;
+    size_t s = n / 2 + 1;
+    if (a->longitud <= s || b->longitud <= s) return;
+    if (n < GCD_HGCD_UMBRAL) {
+        gcd_lehmer(a, b, M, s);
+        return;
+    }
+
+    // La mitad alta deja a y b en unos 3n/4 bloques; si no llega, pasos
+    // de división hasta ahí
+    gcd_hgcd_alto(a, b, n / 2, M);
+    while ((a->longitud > b->longitud ? a->longitud : b->longitud) > 3 * n / 4 + 1)
+        if (!gcd_division(a, b, M, s)) return;
+
+    // Segunda mitad sobre los 2(n2 - s) - 1 bloques altos, que también
+    // deja los restos por encima de BASE^s
+    size_t n2 = a->longitud > b->longitud ? a->longitud : b->longitud;
+    if (n2 > s + 2) gcd_hgcd_alto(a, b, 2 * s - n2 + 1, M);
+
+    // Los últimos pasos, hasta el resto que baja de BASE^s
+    gcd_lehmer(a, b, M, s);
+}
+
+// Reduce (a, b) hasta b = 0, con a = gcd; acumula en M si no es NULL
+static void gcd_reducir(BigInt *a, BigInt *b, GcdMatriz *M) {
+    while (!bg_es_cero(b) && a->longitud >= GCD_HGCD_UMBRAL) {
+        GcdMatriz N;
+        gcd_matriz_iniciar(&N);
+        gcd_hgcd(a, b, &N);
+        if (gcd_matriz_identidad(&N)) {
+            // b demasiado corto para el medio gcd: una división lo iguala
+            gcd_division(a, b, M, 0);
+        } else if (M) {
+            gcd_matriz_mul(M, &N);
+        }
+        gcd_matriz_liberar(&N);
+    }
+    gcd_lehmer(a, b, M, 0);
+}
+
+// dst = gcd(|a|, |b|) >= 0; dst puede ser a o b
+void bg_gcd_into(BigInt *dst, const BigInt *a, const BigInt *b) {
+    BG_OP_INICIO();
+    BgArena *previa = bg_temporal_abrir();
+    BigInt *x = bg_clone(a), *y = bg_clone(b);
+    x->signo = y->signo = +1;
+    gcd_reducir(x, y, NULL);
+    bg_copiar_en(dst, x);
+    bg_temporal_cerrar(previa);
+    BG_OP_FIN(BG_OP_GCD);
+}
+
+BigInt* bg_gcd(const BigInt *a, const BigInt *b) {
+    BigInt *r = bg_nuevo();
+    bg_gcd_into(r, a, b);
+    return r;
+}
+
+// Con g = s a + t b (a, b > 0), lleva s a |s| <= b/2g y t con él.
+// Los restos del medio gcd no siempre son los de Euclides, así que los
+// cofactores de la matriz pueden pasar de esa cota (hasta b/g).
+static void gcd_cofactores_ajustar(BigInt *s, BigInt *t, const BigInt *a, const BigInt *b,
+                                   const BigInt *g) {
+    BigInt *r, *ra, *rb;
+    BigInt *ag = bg_dividir_largo(a, g, &ra);
+    BigInt *bg = bg_dividir_largo(b, g, &rb);
+    BigInt *k = bg_dividir_largo(s, bg, &r);    // s = k bg + r, |r| < bg
+    sumar_en(rb, r, r, r->signo);
+    if (mag_comparar(rb->bloques, rb->longitud, bg->bloques, bg->longitud) > 0) {
+        BigInt *uno = bg_uno();
+        uno->signo = r->signo;
+        sumar_en(k, k, uno, uno->signo);
+        bg_liberar(uno);
+    }
+    if (!bg_es_cero(k)) {
+        bg_mul_into(r, k, bg);
+        sumar_en(s, s, r, -r->signo);
+        bg_mul_into(r, k, ag);
+        sumar_en(t, t, r, r->signo);
+    }
+    bg_liberar(ag); bg_liberar(bg); bg_liberar(k);
+    bg_liberar(r); bg_liberar(ra); bg_liberar(rb);
+}
+
+// g = gcd(|a|, |b|) = s a + t b; s y t (si no son NULL) reciben
+// cofactores nuevos con |s| <= |b| / 2g y |t| <= |a| / 2g salvo en los
+// casos triviales
+BigInt* bg_gcdext(const BigInt *a, const BigInt *b, BigInt **s, BigInt **t) {
+    BG_OP_INICIO();
+    BigInt *g = bg_nuevo();
+    BigInt *cs = bg_nuevo(), *ct = bg_nuevo();
+    BgArena *previa = bg_temporal_abrir();
+    BigInt *x = bg_clone(a), *y = bg_clone(b);
+    x->signo = y->signo = +1;
+    GcdMatriz M;
+    gcd_matriz_iniciar(&M);
+    gcd_reducir(x, y, &M);
+
+    // g = det (m11 |a| - m01 |b|)
+    BigInt *ma = bg_clone(a), *mb = bg_clone(b);
+    ma->signo = mb->signo = +1;
+    M.m[3]->signo = bg_es_cero(M.m[3]) ? +1 : M.det;
+    M.m[1]->signo = bg_es_cero(M.m[1]) ? +1 : -M.det;
+    if (!bg_es_cero(ma) && !bg_es_cero(mb))
+        gcd_cofactores_ajustar(M.m[3], M.m[1], ma, mb, x);
+    bg_copiar_en(g, x);
+    bg_copiar_en(cs, M.m[3]);
+    bg_copiar_en(ct, M.m[1]);
+    if (!bg_es_cero(cs)) cs->signo *= a->signo;
+    if (!bg_es_cero(ct)) ct->signo *= b->signo;
+    bg_temporal_cerrar(previa);
+
+    if (s) *s = cs; else bg_liberar(cs);
+    if (t) *t = ct; else bg_liberar(ct);
+    BG_OP_FIN(BG_OP_GCD);
+    return g;
+}
+
+// ---------------------------------------------------------------------
+// Raíces enteras
+//
+// bg_iroot(a, k) da floor(|a|^(1/k)), con el signo de a si k es impar, y
+// el resto a - r^k. La raíz de a sale de la de a' = a >> kj: si r' es la
+// raíz de a', (r' + 1) 2^j queda por encima de la de a con un error
+// relativo de 2^-j, y un paso de Newton desde arriba,
+//   x = ((k - 1) x + a / x^(k-1)) / k,
+// lo deja a unas pocas unidades. Con j algo menos de la mitad de los
+// bits de la raíz cada nivel dobla la precisión con una potencia y una
+// división de su tamaño, así que el total es un múltiplo fijo de una
+// multiplicación. La recursión acaba en un doble bloque, con Newton
+// sobre palabras de máquina. Arriba, más pasos de Newton hasta x^k <= a
+// dan la raíz exacta: desde arriba Newton nunca baja de ella.
+// ---------------------------------------------------------------------
+
+// Bits de |a|: exactos en las bases binarias, una cota por exceso en
+// base 10^9 (log2(10^9) = 29.8974)
+static size_t raiz_bits(const BigInt *a) {
+    size_t n = a->longitud;
+#ifdef BG_DECIMAL
+    return ((n - 1) * 29898 + 999) / 1000 + bits_doble(a->bloques[n - 1]);
+#else
+    return (n - 1) * BG_LIMB_BITS + bits_doble(a->bloques[n - 1]);
+#endif
+}
+
+// floor(a^(1/k)) de un doble bloque, k >= 2. a / x^(k-1) se hace con k-1
+// divisiones entre x, que dan el mismo suelo y no desbordan.
+static bg_dlimb raiz_doble(bg_dlimb a, unsigned long k) {
+    if (a < 2) return a;
+    unsigned bits = bits_doble(a);
+    if (k >= bits) return 1;
+    bg_dlimb x = (bg_dlimb)1 << ((bits + k - 1) / k);
+    for (;;) {
+        bg_dlimb t = a;
+        for (unsigned long i = 1; i < k && t; i++) t /= x;
+        bg_dlimb y = ((bg_dlimb)(k - 1) * x + t) / k;
+        if (y >= x) return x;
+        x = y;
+    }
+}
+
+// p = x^e, e >= 1, desde el bit alto de e; p no puede ser x
+static void raiz_potencia(BigInt *p, const BigInt *x, unsigned long e) {
+    int i = 8 * sizeof e - 1;
+    while (!((e >> i) & 1)) i--;
+    bg_copiar_en(p, x);
+    while (i-- > 0) {
+        bg_square_into(p, p);
+        if ((e >> i) & 1) bg_mul_into(p, p, x);
+    }
+}
+
+// Un paso de Newton desde x >= a^(1/k); deja x en [floor(a^(1/k)), x].
+// kb es k como BigInt.
+static void raiz_newton(BigInt *x, const BigInt *a, unsigned long k, const BigInt *kb) {
+    BigInt *p = x, *resto, *resto_k;
+    if (k > 2) {
+        p = bg_nuevo();
+        raiz_potencia(p, x, k - 1);
+    }
+    BigInt *t = bg_dividir_largo(a, p, &resto);
+    BigInt *kx = bg_nuevo();
+    bg_mul_into(kx, x, kb);
+    sumar_en(t, t, kx, +1);
+    sumar_en(t, t, x, -1);                      // (k - 1) x + a / x^(k-1)
+    BigInt *nuevo = bg_dividir_largo(t, kb, &resto_k);
+    bg_copiar_en(x, nuevo);
+    if (p != x) bg_liberar(p);
+    bg_liberar(t); bg_liberar(resto); bg_liberar(kx);
+    bg_liberar(nuevo); bg_liberar(resto_k);
+}
+
+// x >= floor(a^(1/k)) para a >= 0 y k >= 2, a pocas unidades de la raíz
+static void raiz_aprox(BigInt *x, const BigInt *a, unsigned long k, const BigInt *kb) {
+    if (a->longitud <= 2) {
+        bg_limb alto = a->longitud > 1 ? a->bloques[1] : 0;
+        bg_fijar_doble(x, raiz_doble(BG_JUNTAR(alto, a->bloques[0]), k));
+        return;
+    }
+    size_t bits_raiz = raiz_bits(a) / k + 1;
+    size_t j = bits_raiz / 2 > 3 ? bits_raiz / 2 - 2 : 1;
+    BigInt *alto = bg_nuevo(), *uno = bg_uno();
+    bg_shr_into(alto, a, k * j);
+    raiz_aprox(x, alto, k, kb);
+    sumar_en(x, x, uno, +1);
+    bg_shl_into(x, x, j);                       // (r' + 1) 2^j
+    raiz_newton(x, a, k, kb);
+    bg_liberar(alto);
+    bg_liberar(uno);
+}
+
+// Raíz k-ésima entera: floor(|a|^(1/k)) con el signo de a, y en *resto
+// (si no es NULL) a - r^k, también con el signo de a. k par exige a >= 0.
+BigInt* bg_iroot(const BigInt *a, unsigned long k, BigInt **resto) {
+    if (k == 0) {
+        fprintf(stderr, "Error: Raíz de índice cero\n");
+        exit(1);
+    }
+    if (a->signo < 0 && !bg_es_cero(a) && k % 2 == 0) {
+        fprintf(stderr, "Error: Raíz de índice par de un número negativo\n");
+        exit(1);
+    }
+    BG_OP_INICIO();
+    BigInt *r = bg_nuevo(), *m = bg_nuevo();
+    BgArena *previa = bg_temporal_abrir();
+    BigInt *x = bg_nuevo(), *p = bg_nuevo(), *kb = bg_nuevo();
+    BigInt *abs_a = bg_clone(a);
+    abs_a->signo = +1;
+    size_t bits = raiz_bits(abs_a);
+
+    if (k == 1 || bits <= 1) {
+        bg_copiar_en(x, abs_a);                 // 0, 1 o a^(1/1): x^k = x
+        bg_copiar_en(p, x);
+    } else if (k >= bits) {
+        bg_fijar_doble(x, 1);                 // 1 < |a| < 2^k
+        bg_copiar_en(p, x);
+    } else {
+        bg_fijar_doble(kb, k);
+        raiz_aprox(x, abs_a, k, kb);
+        raiz_potencia(p, x, k);
+        while (mag_comparar(p->bloques, p->longitud, abs_a->bloques, abs_a->longitud) > 0) {
+            raiz_newton(x, abs_a, k, kb);
+            raiz_potencia(p, x, k);
+        }
+    }
+    sumar_en(m, abs_a, p, -1);
+    bg_copiar_en(r, x);
+    if (a->signo < 0) {
+        if (!bg_es_cero(r)) r->signo = -1;
+        if (!bg_es_cero(m)) m->signo = -1;
+    }
+    bg_temporal_cerrar(previa);
+
+    if (resto) *resto = m; else bg_liberar(m);
+    BG_OP_FIN(BG_OP_RAIZ);
+    return r;
+}
+
+// Raíz cuadrada entera de a >= 0, con resto a - r^2 si no es NULL
+BigInt* bg_isqrt(const BigInt *a, BigInt **resto) {
+    return bg_iroot(a, 2, resto);
+}
+
+// ---------------------------------------------------------------------
+// Productos y series
+//
+// Los productos grandes se hacen con un árbol equilibrado: los factores
+// se juntan primero en dobles bloques y las hojas se multiplican por
+// parejas, así cada producto es de dos mitades parecidas y cae en el
+// nivel rápido que le toca. bg_factorial y bg_binomial factorizan el
+// resultado con Legendre, n! = prod p^e(p), y lo arman por los bits de
+// los exponentes: r = r^2 * (primos con ese bit encendido), del bit alto
+// al bajo, con el factor 2^e(2) como desplazamiento final.
+//
+// bg_serie suma series de tipo hipergeométrico por división binaria: el
+// intervalo [n1, n2) da P, Q, B y T enteros con la suma igual a
+// T / (B Q), y dos mitades se juntan con
+//   P = P1 P2, Q = Q1 Q2, B = B1 B2, T = B2 Q2 T1 + B1 P1 T2,
+// también productos de tamaños parecidos.
+// ---------------------------------------------------------------------
+
+// Primos <= n por la criba de Eratóstenes sobre los impares, en un
+// vector nuevo; *np recibe cuántos son
+static unsigned long* primos_hasta(unsigned long n, size_t *np) {
+    *np = 0;
+    if (n < 2) return NULL;
+    size_t m = n / 2 + 1;                       // bit i: 2i + 1
+    unsigned char *compuesto = calloc(m / 8 + 1, 1);
+    size_t total = 1;
+    for (size_t i = 1; i < m; i++) {
+        if (compuesto[i / 8] & (1u << (i % 8))) continue;
+        unsigned long p = 2 * i + 1;
+        if (p > n) break;
+        total++;
+        for (unsigned long j = p * p / 2; p <= n / p && j < m; j += p)
+            compuesto[j / 8] |= (unsigned char)(1u << (j % 8));
+    }
+    unsigned long *primos = malloc(total * sizeof(unsigned long));
+    primos[(*np)++] = 2;
+    for (size_t i = 1; i < m && 2 * i + 1 <= n; i++)
+        if (!(compuesto[i / 8] & (1u << (i % 8)))) primos[(*np)++] = 2 * i + 1;
+    free(compuesto);
+    return primos;
+}
+
+// r = h[0] ... h[m-1], partiendo siempre por la mitad
+static void producto_hojas(BigInt *r, const bg_dlimb *h, size_t m) {
+    if (m <= 1) {
+        bg_fijar_doble(r, m ? h[0] : 1);
+        return;
+    }
+    BigInt *d = bg_nuevo();
+    producto_hojas(r, h, m / 2);
+    producto_hojas(d, h + m / 2, m - m / 2);
+    bg_mul_into(r, r, d);
+    bg_liberar(d);
+}
+
+// r = v[0] ... v[n-1] por un árbol equilibrado; los factores se juntan
+// en hojas de un doble bloque
+static void producto_arbol(BigInt *r, const unsigned long *v, size_t n) {
+    bg_dlimb *h = malloc((n ? n : 1) * sizeof(bg_dlimb));
+    size_t m = 0;
+    for (size_t i = 0; i < n; ) {
+        bg_dlimb acum = v[i++];
+        while (i < n && acum <= (~(bg_dlimb)0) / v[i]) acum *= v[i++];
+        h[m++] = acum;
+    }
+    producto_hojas(r, h, m);
+    free(h);
+}
+
+// r = prod primos[i]^e[i], por los bits de los exponentes
+static void producto_potencias(BigInt *r, const unsigned long *primos,
+                               const unsigned long *e, size_t np) {
+    unsigned long todos = 0;
+    for (size_t i = 0; i < np; i++) todos |= e[i];
+    unsigned long *elegidos = malloc((np ? np : 1) * sizeof(unsigned long));
+    BigInt *t = bg_nuevo();
+    bg_fijar_entero(r, 1);
+    for (int b = 8 * sizeof todos - 1; b >= 0; b--) {
+        if (!(todos >> b)) continue;
+        size_t m = 0;
+        for (size_t i = 0; i < np; i++)
+            if ((e[i] >> b) & 1) elegidos[m++] = primos[i];
+        bg_square_into(r, r);
+        if (m == 0) continue;
+        producto_arbol(t, elegidos, m);
+        bg_mul_into(r, r, t);
+    }
+    bg_liberar(t);
+    free(elegidos);
+}
+
+// Exponente de p en n! (Legendre)
+static unsigned long legendre(unsigned long n, unsigned long p) {
+    unsigned long e = 0;
+    while (n >= p) {
+        n /= p;
+        e += n;
+    }
+    return e;
+}
+
+// r = prod p^e(p) para los primos p <= n con e(p) = e_n(p) - e_k(p) -
+// e_j(p) (exponentes de Legendre), sacando 2^e(2) como desplazamiento
+static BigInt* producto_legendre(unsigned long n, unsigned long k, unsigned long j) {
+    size_t np;
+    unsigned long *primos = primos_hasta(n, &np);
+    BigInt *r = bg_nuevo();
+    BgArena *previa = bg_temporal_abrir();
+    unsigned long *e = malloc((np ? np : 1) * sizeof(unsigned long));
+    for (size_t i = 0; i < np; i++)
+        e[i] = legendre(n, primos[i]) - legendre(k, primos[i]) - legendre(j, primos[i]);
+    BigInt *impar = bg_nuevo();
+    producto_potencias(impar, np ? primos + 1 : NULL, e + 1, np ? np - 1 : 0);
+    bg_shl_into(r, impar, np ? e[0] : 0);
+    bg_temporal_cerrar(previa);
+    free(e);
+    free(primos);
+    return r;
+}
+
+// n!
+BigInt* bg_factorial(unsigned long n) {
+    BG_OP_INICIO();
+    BigInt *r = producto_legendre(n, 0, 0);
+    BG_OP_FIN(BG_OP_PRODUCTO);
+    return r;
+}
+
+// Coeficiente binomial n sobre k; 0 si k > n
+BigInt* bg_binomial(unsigned long n, unsigned long k) {
+    BG_OP_INICIO();
+    BigInt *r;
+    if (k > n) {
+        r = bg_cero();
+    } else {
+        r = producto_legendre(n, k, n - k);
+    }
+    BG_OP_FIN(BG_OP_PRODUCTO);
+    return r;
+}
+
+// Producto de los primos <= n
+BigInt* bg_primorial(unsigned long n) {
+    BG_OP_INICIO();
+    size_t np;
+    unsigned long *primos = primos_hasta(n, &np);
+    BigInt *r = bg_nuevo();
+    BgArena *previa = bg_temporal_abrir();
+    BigInt *t = bg_nuevo();
+    producto_arbol(t, primos, np);
+    bg_copiar_en(r, t);
+    bg_temporal_cerrar(previa);
+    free(primos);
+    BG_OP_FIN(BG_OP_PRODUCTO);
+    return r;
+}
+
+// División binaria de [n1, n2); B es NULL si la serie no tiene b(k)
+static void serie_partir(const BgSerie *s, unsigned long n1, unsigned long n2,
+                         BigInt *P, BigInt *Q, BigInt *B, BigInt *T) {
+    if (n2 - n1 == 1) {
+        s->p(P, n1, s->datos);
+        s->q(Q, n1, s->datos);
+        if (B) s->b(B, n1, s->datos);
+        s->a(T, n1, s->datos);
+        bg_mul_into(T, T, P);
+        return;
+    }
+    unsigned long m = n1 + (n2 - n1) / 2;
+    BigInt *P2 = bg_nuevo(), *Q2 = bg_nuevo(), *T2 = bg_nuevo();
+    BigInt *B2 = B ? bg_nuevo() : NULL;
+    serie_partir(s, n1, m, P, Q, B, T);
+    serie_partir(s, m, n2, P2, Q2, B2, T2);
+
+    bg_mul_into(T, T, Q2);                      // T = B2 Q2 T1 + B1 P1 T2
+    bg_mul_into(T2, T2, P);
+    if (B) {
+        bg_mul_into(T, T, B2);
+        bg_mul_into(T2, T2, B);
+        bg_mul_into(B, B, B2);
+        bg_liberar(B2);
+    }
+    sumar_en(T, T, T2, T2->signo);
+    bg_mul_into(P, P, P2);
+    bg_mul_into(Q, Q, Q2);
+    bg_liberar(P2); bg_liberar(Q2); bg_liberar(T2);
+}
+
+// Suma de los términos n1 <= k < n2 de la serie s como T / (B Q), con P
+// el producto de los p(k). P y B pueden ser NULL; sin s->b, B = 1.
+void bg_serie(const BgSerie *s, unsigned long n1, unsigned long n2,
+              BigInt *P, BigInt *Q, BigInt *B, BigInt *T) {
+    if (n2 <= n1) {
+        fprintf(stderr, "Error: Intervalo vacío en bg_serie\n");
+        exit(1);
+    }
+    BG_OP_INICIO();
+    BgArena *previa = bg_temporal_abrir();
+    BigInt *p = bg_nuevo(), *q = bg_nuevo(), *t = bg_nuevo();
+    BigInt *b = s->b ? bg_nuevo() : NULL;
+    serie_partir(s, n1, n2, p, q, b, t);
+    if (P) bg_copiar_en(P, p);
+    bg_copiar_en(Q, q);
+    if (B && b) bg_copiar_en(B, b);
+    else if (B) bg_fijar_entero(B, 1);
+    bg_copiar_en(T, t);
+    bg_temporal_cerrar(previa);
+    BG_OP_FIN(BG_OP_PRODUCTO);
+}
+
+// ---------------------------------------------------------------------
+// Racionales
+//
+// BigRat guarda num / den con den > 0 y el signo en num. Reducir del
+// todo en cada paso cuesta un gcd del tamaño del resultado, y en cálculos
+// con muchos racionales es lo que se lleva casi todo el tiempo. Las
+// operaciones miden primero los cuatro términos de los operandos:
+//   - Hasta q->presupuesto bloques (el del destino), productos cruzados
+//     sin ningún gcd, con atajos para denominadores iguales o 1. El
+//     resultado queda sin reducir y crece como mucho hasta el presupuesto.
+//   - Por encima, se reducen los operandos que no lo estén y el resultado
+//     sale reducido con los gcd de Henrici sobre los términos cruzados,
+//     de la mitad de tamaño que el del resultado:
+//       a/b * c/d = (a/g1)(c/g2) / ((b/g2)(d/g1)),  g1 = (a, d), g2 = (c, b)
+//       a/b + c/d = (t/g2) / ((b/g)(d/g2)),  g = (b, d), g2 = (t, g),
+//                   t = a (d/g) + c (b/g)
+// Con presupuesto 0 todo va por Henrici y los resultados salen siempre
+// reducidos. bg_rat_reducir y bg_rat_a_cadena reducen al pedirlos.
+// ---------------------------------------------------------------------
+
+#ifndef RAT_PRESUPUESTO
+#define RAT_PRESUPUESTO 64   // bloques de num y den de los dos operandos
+#endif
+
+static int rat_es_uno(const BigInt *x) {
+    return x->longitud == 1 && x->bloques[0] == 1 && x->signo > 0;
+}
+
+// dst = a / g cuando g > 0 divide a a
+static void rat_dividir(BigInt *dst, const BigInt *a, const BigInt *g) {
+    if (rat_es_uno(g) || bg_es_cero(a)) {
+        bg_copiar_en(dst, a);
+        return;
+    }
+    size_t an = a->longitud, n = g->longitud, cap;
+    BigInt *q = bg_nuevo();
+    bg_limb *r = bg_trabajo_pedir(n, &cap);
+    bg_crecer(q, an - n + 1);
+    mag_divrem(q->bloques, r, a->bloques, an, g->bloques, n);
+    bg_trabajo_devolver(r, cap);
+    q->signo = a->signo;
+    bg_fijar_longitud(q, an - n + 1);
+    bg_copiar_en(dst, q);
+    bg_liberar(q);
+}
+
+// num / den = num / den reducido; el cero queda como 0 / 1
+static void rat_reducir_en(BigInt *num, BigInt *den) {
+    if (bg_es_cero(num)) {
+        bg_fijar_entero(den, 1);
+        return;
+    }
+    if (rat_es_uno(den)) return;
+    BigInt *g = bg_nuevo();
+    bg_gcd_into(g, num, den);
+    rat_dividir(num, num, g);
+    rat_dividir(den, den, g);
+    bg_liberar(g);
+}
+
+// Deja el resultado n / d en dst, reduciéndolo si se pasa del
+// presupuesto; n y d son temporales
+static void rat_guardar(BigRat *dst, BigInt *n, BigInt *d, int reducido) {
+    if (bg_es_cero(n)) {
+        bg_fijar_entero(d, 1);
+        reducido = 1;
+    }
+    reducido = reducido || rat_es_uno(d);
+    if (!reducido && n->longitud + d->longitud > dst->presupuesto) {
+        rat_reducir_en(n, d);
+        reducido = 1;
+    }
+    bg_copiar_en(dst->num, n);
+    bg_copiar_en(dst->den, d);
+    dst->reducido = reducido;
+}
+
+// Vista reducida de q en el ámbito temporal: q mismo si ya lo está
+static const BigRat* rat_reducido(const BigRat *q, BigRat *copia) {
+    if (q->reducido) return q;
+    copia->num = bg_clone(q->num);
+    copia->den = bg_clone(q->den);
+    rat_reducir_en(copia->num, copia->den);
+    copia->reducido = 1;
+    return copia;
+}
+
+static size_t rat_bloques(const BigRat *a, const BigRat *b) {
+    return a->num->longitud + a->den->longitud + b->num->longitud + b->den->longitud;
+}
+
+// n / d = a + signo_b b
+static int rat_sumar(BigInt *n, BigInt *d, const BigRat *a, const BigRat *b,
+                     int signo_b, size_t presupuesto) {
+    BigInt *t = bg_nuevo();
+    if (rat_bloques(a, b) <= presupuesto) {
+        if (compararBigInt(a->den, b->den) == 0) {
+            sumar_en(n, a->num, b->num, signo_b * b->num->signo);
+            bg_copiar_en(d, a->den);
+        } else {
+            bg_mul_into(n, a->num, b->den);
+            bg_mul_into(t, b->num, a->den);
+            sumar_en(n, n, t, signo_b * t->signo);
+            bg_mul_into(d, a->den, b->den);
+        }
+        bg_liberar(t);
+        return 0;
+    }
+
+    BigRat ra, rb;
+    a = rat_reducido(a, &ra);
+    b = rat_reducido(b, &rb);
+    BigInt *g = bg_nuevo(), *b1 = bg_nuevo(), *d1 = bg_nuevo();
+    bg_gcd_into(g, a->den, b->den);
+    rat_dividir(b1, a->den, g);
+    rat_dividir(d1, b->den, g);
+    bg_mul_into(n, a->num, d1);                 // t = a (d/g) + c (b/g)
+    bg_mul_into(t, b->num, b1);
+    sumar_en(n, n, t, signo_b * t->signo);
+    if (!rat_es_uno(g)) {
+        bg_gcd_into(g, n, g);
+        rat_dividir(n, n, g);
+        rat_dividir(d1, b->den, g);
+    }
+    bg_mul_into(d, b1, d1);
+    bg_liberar(g); bg_liberar(b1); bg_liberar(d1); bg_liberar(t);
+    return 1;
+}
+
+// n / d = a * b, con b dado por su numerador y denominador
+static int rat_multiplicar(BigInt *n, BigInt *d, const BigRat *a, const BigRat *b,
+                           size_t presupuesto) {
+    if (rat_bloques(a, b) <= presupuesto) {
+        bg_mul_into(n, a->num, b->num);
+        bg_mul_into(d, a->den, b->den);
+        return 0;
+    }
+
+    BigRat ra, rb;
+    a = rat_reducido(a, &ra);
+    b = rat_reducido(b, &rb);
+    BigInt *g1 = bg_nuevo(), *g2 = bg_nuevo(), *x = bg_nuevo(), *y = bg_nuevo();
+    bg_gcd_into(g1, a->num, b->den);
+    bg_gcd_into(g2, b->num, a->den);
+    rat_dividir(x, a->num, g1);
+    rat_dividir(y, b->num, g2);
+    bg_mul_into(n, x, y);
+    rat_dividir(x, a->den, g2);
+    rat_dividir(y, b->den, g1);
+    bg_mul_into(d, x, y);
+    bg_liberar(g1); bg_liberar(g2); bg_liberar(x); bg_liberar(y);
+    return 1;
+}
+
+BigRat* bg_rat_nuevo(void) {
+    BigRat *q = malloc(sizeof(BigRat));
+    q->num = bg_cero();
+    q->den = bg_uno();
+    q->reducido = 1;
+    q->presupuesto = RAT_PRESUPUESTO;
+    return q;
+}
+
+void bg_rat_liberar(BigRat *q) {
+    if (!q) return;
+    bg_liberar(q->num);
+    bg_liberar(q->den);
+    free(q);
+}
+
+// q = num / den, sin reducir salvo con presupuesto 0
+void bg_rat_fijar(BigRat *q, const BigInt *num, const BigInt *den) {
+    if (bg_es_cero(den)) {
+        fprintf(stderr, "Error: Denominador cero\n");
+        exit(1);
+    }
+    bg_copiar_en(q->num, num);
+    bg_copiar_en(q->den, den);
+    if (den->signo < 0) {
+        q->den->signo = +1;
+        if (!bg_es_cero(q->num)) q->num->signo = -q->num->signo;
+    }
+    q->reducido = rat_es_uno(q->den);
+    if (q->presupuesto == 0) bg_rat_reducir(q);
+}
+
+// "a/b" o "a"
+BigRat* bg_rat_desde_cadena(const char *s) {
+    BigRat *q = bg_rat_nuevo();
+    const char *barra = strchr(s, '/');
+    if (!barra) {
+        BigInt *n = bg_desde_cadena(s);
+        bg_copiar_en(q->num, n);
+        bg_liberar(n);
+        return q;
+    }
+    char *izq = malloc(barra - s + 1);
+    memcpy(izq, s, barra - s);
+    izq[barra - s] = '\0';
+    BigInt *n = bg_desde_cadena(izq), *d = bg_desde_cadena(barra + 1);
+    bg_rat_fijar(q, n, d);
+    bg_liberar(n);
+    bg_liberar(d);
+    free(izq);
+    return q;
+}
+
+void bg_rat_reducir(BigRat *q) {
+    if (q->reducido) return;
+    BG_OP_INICIO();
+    BgArena *previa = bg_temporal_abrir();
+    BigInt *n = bg_clone(q->num), *d = bg_clone(q->den);
+    rat_reducir_en(n, d);
+    bg_copiar_en(q->num, n);
+    bg_copiar_en(q->den, d);
+    q->reducido = 1;
+    bg_temporal_cerrar(previa);
+    BG_OP_FIN(BG_OP_RACIONAL);
+}
+
+// Reduce q y lo escribe como "num/den", o "num" si es entero
+char* bg_rat_a_cadena(BigRat *q) {
+    bg_rat_reducir(q);
+    char *n = bg_a_cadena(q->num);
+    if (rat_es_uno(q->den)) return n;
+    char *d = bg_a_cadena(q->den);
+    size_t ln = strlen(n), ld = strlen(d);
+    char *s = malloc(ln + ld + 2);
+    memcpy(s, n, ln);
+    s[ln] = '/';
+    memcpy(s + ln + 1, d, ld + 1);
+    free(n);
+    free(d);
+    return s;
+}
+
+static void rat_sumar_into(BigRat *dst, const BigRat *a, const BigRat *b, int signo_b) {
+    BG_OP_INICIO();
+    BgArena *previa = bg_temporal_abrir();
+    BigInt *n = bg_nuevo(), *d = bg_nuevo();
+    int reducido = rat_sumar(n, d, a, b, signo_b, dst->presupuesto);
+    rat_guardar(dst, n, d, reducido);
+    bg_temporal_cerrar(previa);
+    BG_OP_FIN(BG_OP_RACIONAL);
+}
+
+void bg_rat_add_into(BigRat *dst, const BigRat *a, const BigRat *b) {
+    rat_sumar_into(dst, a, b, +1);
+}
+
+void bg_rat_sub_into(BigRat *dst, const BigRat *a, const BigRat *b) {
+    rat_sumar_into(dst, a, b, -1);
+}
+
+void bg_rat_mul_into(BigRat *dst, const BigRat *a, const BigRat *b) {
+    BG_OP_INICIO();
+    BgArena *previa = bg_temporal_abrir();
+    BigInt *n = bg_nuevo(), *d = bg_nuevo();
+    int reducido = rat_multiplicar(n, d, a, b, dst->presupuesto);
+    rat_guardar(dst, n, d, reducido);
+    bg_temporal_cerrar(previa);
+    BG_OP_FIN(BG_OP_RACIONAL);
+}
+
+// dst = a / b: a por el inverso de b, con el signo pasado al numerador
+void bg_rat_div_into(BigRat *dst, const BigRat *a, const BigRat *b) {
+    if (bg_es_cero(b->num)) {
+        fprintf(stderr, "Error: División por cero\n");
+        exit(1);
+    }
+    BG_OP_INICIO();
+    BgArena *previa = bg_temporal_abrir();
+    BigRat inv = { bg_clone(b->den), bg_clone(b->num), b->reducido, 0 };
+    inv.num->signo = b->num->signo;
+    inv.den->signo = +1;
+    BigInt *n = bg_nuevo(), *d = bg_nuevo();
+    int reducido = rat_multiplicar(n, d, a, &inv, dst->presupuesto);
+    rat_guardar(dst, n, d, reducido);
+    bg_temporal_cerrar(previa);
+    BG_OP_FIN(BG_OP_RACIONAL);
+}
+
+// Signo de a - b, sin reducir: compara a.num b.den con b.num a.den
+int bg_rat_comparar(const BigRat *a, const BigRat *b) {
+    int sa = bg_es_cero(a->num) ? 0 : a->num->signo;
+    int sb = bg_es_cero(b->num) ? 0 : b->num->signo;
+    if (sa != sb) return sa > sb ? 1 : -1;
+    if (sa == 0) return 0;
+    BgArena *previa = bg_temporal_abrir();
+    BigInt *x = bg_nuevo(), *y = bg_nuevo();
+    bg_mul_into(x, a->num, b->den);
+    bg_mul_into(y, b->num, a->den);
+    int c = compararBigInt(x, y);
+    bg_temporal_cerrar(previa);
+    return c;
+}
+
+// ---------------------------------------------------------------------
+// Polinomios
+//
+// BigPoli guarda c[0] + c[1] x + ... + c[n-1] x^(n-1) con los n
+// coeficientes contiguos en un vector de BigInt y c[n-1] != 0; el
+// polinomio cero tiene n = 0. Las cabeceras de c[n], ..., c[capacidad-1]
+// siguen iniciadas para volver a usarlas, y todas toman sus bloques de
+// la arena que estaba activa al crear el polinomio.
+//
+// El producto va por sustitución de Kronecker: cada polinomio se
+// convierte en el entero A(X), con X = BASE^k y k bloques por
+// coeficiente, se multiplican los dos enteros con la multiplicación de
+// la biblioteca y los coeficientes del producto se leen de los trozos
+// de k bloques de A(X) B(X). Con k = ka + kb + 1 (ka y kb los bloques
+// del mayor coeficiente de cada factor) todo coeficiente del producto
+// queda por debajo de X/2 en valor absoluto, así que los trozos se leen
+// en forma equilibrada: un trozo v >= X/2 es el coeficiente v - X y
+// presta uno al siguiente. Los coeficientes negativos se restan al
+// empaquetar: A(X) = (positivos) - (negativos).
+//
+// La pseudodivisión es la de Knuth (algoritmo R): da q y r con
+//   lc(b)^(m-n+1) a = q b + r,  grado r < grado b,
+// sin salir de los enteros.
+// ---------------------------------------------------------------------
+
+static void poli_coef_iniciar(BigInt *z, BgArena *ar) {
+    z->signo     = +1;
+    z->bloques   = NULL;
+    z->longitud  = 0;
+    z->capacidad = 0;
+    z->arena     = ar;
+    bg_append(z, 0);
+}
+
+static void poli_coef_soltar(BigInt *z) {
+    if (z->arena) {
+        bg_arena_devolver(z->arena, z->bloques, z->capacidad);
+        return;
+    }
+    BG_CONTAR_LIBERA(z->capacidad * sizeof(bg_limb));
+    free(z->bloques);
+}
+
+// p pasa a tener n coeficientes; los nuevos valen cero
+static void poli_fijar_longitud(BigPoli *p, size_t n) {
+    if (n > p->capacidad) {
+        size_t cap = p->capacidad ? p->capacidad * 2 : 4;
+        while (cap < n) cap *= 2;
+        BigInt *c = realloc(p->c, cap * sizeof(BigInt));
+        if (!c) {
+            fprintf(stderr, "Error: no se pudo reservar memoria\n");
+            exit(1);
+        }
+        for (size_t i = p->capacidad; i < cap; i++) poli_coef_iniciar(&c[i], p->arena);
+        p->c = c;
+        p->capacidad = cap;
+    }
+    for (size_t i = p->longitud; i < n; i++) bg_fijar_entero(&p->c[i], 0);
+    p->longitud = n;
+}
+
+// Quita los coeficientes altos nulos
+static void poli_normalizar(BigPoli *p) {
+    while (p->longitud > 0 && bg_es_cero(&p->c[p->longitud - 1])) p->longitud--;
+}
+
+static void poli_copiar_en(BigPoli *dst, const BigPoli *a) {
+    if (dst == a) return;
+    poli_fijar_longitud(dst, a->longitud);
+    for (size_t i = 0; i < a->longitud; i++) bg_copiar_en(&dst->c[i], &a->c[i]);
+}
+
+// dst = a * k coeficiente a coeficiente
+static void poli_escalar(BigPoli *dst, const BigPoli *a, const BigInt *k) {
+    if (bg_es_cero(k)) {
+        dst->longitud = 0;
+        return;
+    }
+    poli_fijar_longitud(dst, a->longitud);
+    for (size_t i = 0; i < a->longitud; i++) bg_mul_into(&dst->c[i], &a->c[i], k);
+}
+
+// Bloques del mayor coeficiente
+static size_t poli_bloques(const BigPoli *p) {
+    size_t k = 1;
+    for (size_t i = 0; i < p->longitud; i++)
+        if (p->c[i].longitud > k) k = p->c[i].longitud;
+    return k;
+}
+
+// z = p(BASE^k), con cada coeficiente en su trozo de k bloques
+static void poli_empaquetar(BigInt *z, const BigPoli *p, size_t k) {
+    size_t n = p->longitud * k;
+    BigInt *pos = bg_nuevo(), *neg = bg_nuevo();
+    bg_crecer(pos, n);
+    memset(pos->bloques, 0, n * sizeof(bg_limb));
+    int negativos = 0;
+    for (size_t i = 0; i < p->longitud; i++) {
+        const BigInt *c = &p->c[i];
+        if (c->signo < 0 && !negativos) {
+            bg_crecer(neg, n);
+            memset(neg->bloques, 0, n * sizeof(bg_limb));
+            negativos = 1;
+        }
+        bg_limb *destino = (c->signo < 0 ? neg : pos)->bloques + i * k;
+        memcpy(destino, c->bloques, c->longitud * sizeof(bg_limb));
+    }
+    bg_fijar_longitud(pos, n);
+    if (negativos) {
+        bg_fijar_longitud(neg, n);
+        sumar_en(z, pos, neg, -1);
+    } else {
+        bg_copiar_en(z, pos);
+    }
+    bg_liberar(pos);
+    bg_liberar(neg);
+}
+
+// dst = los n coeficientes de z en trozos equilibrados de k bloques
+static void poli_desempaquetar(BigPoli *dst, const BigInt *z, size_t n, size_t k) {
+    size_t cap_v, cap_x;
+    bg_limb *v = bg_trabajo_pedir(k, &cap_v);
+    bg_limb *x = bg_trabajo_pedir(k + 1, &cap_x);        // X = BASE^k
+    memset(x, 0, k * sizeof(bg_limb));
+    x[k] = 1;
+    poli_fijar_longitud(dst, n);
+    int acarreo = 0;
+    for (size_t i = 0; i < n; i++) {
+        size_t ini = i * k, m = 0;
+        if (ini < z->longitud) m = z->longitud - ini < k ? z->longitud - ini : k;
+        memcpy(v, z->bloques + ini, m * sizeof(bg_limb));
+        memset(v + m, 0, (k - m) * sizeof(bg_limb));
+        BigInt *c = &dst->c[i];
+        if (acarreo && mag_incrementar(v, k, 1)) {   // v = X
+            bg_fijar_entero(c, 0);
+            continue;
+        }
+        bg_crecer(c, k + 1);
+        acarreo = v[k - 1] >= (bg_limb)(BG_BASE / 2);
+        if (acarreo) {
+            mag_restar(c->bloques, x, k + 1, v, k);
+            c->signo = -z->signo;
+        } else {
+            memcpy(c->bloques, v, k * sizeof(bg_limb));
+            c->signo = z->signo;
+        }
+        bg_fijar_longitud(c, k);
+    }
+    bg_trabajo_devolver(x, cap_x);
+    bg_trabajo_devolver(v, cap_v);
+    poli_normalizar(dst);
+}
+
+// Pseudodivisión (Knuth, algoritmo R) sobre copias: u pasa a ser el
+// pseudorresto y q el pseudocociente; b no es cero
+static void poli_pseudo_divrem(BigPoli *q, BigPoli *u, const BigPoli *b) {
+    size_t n = b->longitud, m = u->longitud;
+    const BigInt *d = &b->c[n - 1];
+    if (m < n) {
+        q->longitud = 0;
+        return;
+    }
+    poli_fijar_longitud(q, m - n + 1);
+    BigInt *t = bg_nuevo();
+    for (size_t k = m - n + 1; k-- > 0; ) {
+        bg_copiar_en(&q->c[k], &u->c[n - 1 + k]);      // luego por d^k
+        for (size_t j = n - 1 + k; j-- > 0; ) {
+            bg_mul_into(&u->c[j], &u->c[j], d);
+            if (j >= k) {
+                bg_mul_into(t, &q->c[k], &b->c[j - k]);
+                bg_sub_into(&u->c[j], &u->c[j], t);
+            }
+        }
+    }
+    bg_fijar_entero(t, 1);
+    for (size_t k = 1; k < m - n + 1; k++) {
+        bg_mul_into(t, t, d);
+        bg_mul_into(&q->c[k], &q->c[k], t);
+    }
+    bg_liberar(t);
+    u->longitud = n - 1;
+    poli_normalizar(u);
+    poli_normalizar(q);
+}
+
+// g = contenido de p, positivo (0 para el polinomio cero)
+static void poli_contenido(BigInt *g, const BigPoli *p) {
+    bg_fijar_entero(g, 0);
+    for (size_t i = 0; i < p->longitud && !rat_es_uno(g); i++)
+        bg_gcd_into(g, g, &p->c[i]);
+}
+
+// p = p / contenido(p), con el coeficiente principal positivo
+static void poli_primitivo(BigPoli *p) {
+    if (p->longitud == 0) return;
+    BigInt *g = bg_nuevo();
+    poli_contenido(g, p);
+    int signo = p->c[p->longitud - 1].signo;
+    for (size_t i = 0; i < p->longitud; i++) {
+        rat_dividir(&p->c[i], &p->c[i], g);
+        if (!bg_es_cero(&p->c[i])) p->c[i].signo *= signo;
+    }
+    bg_liberar(g);
+}
+
+// Los coeficientes se crean en la arena activa al crear p
+BigPoli* bg_poli_nuevo(void) {
+    BigPoli *p = calloc(1, sizeof(BigPoli));
+    p->arena = arena_activa;
+    return p;
+}
+
+void bg_poli_liberar(BigPoli *p) {
+    if (!p) return;
+    for (size_t i = 0; i < p->capacidad; i++) poli_coef_soltar(&p->c[i]);
+    free(p->c);
+    free(p);
+}
+
+// Grado de p; -1 para el polinomio cero
+long bg_poli_grado(const BigPoli *p) {
+    return (long)p->longitud - 1;
+}
+
+// Coeficiente de x^i en p = v
+void bg_poli_fijar_coef(BigPoli *p, size_t i, const BigInt *v) {
+    if (i >= p->longitud) {
+        if (bg_es_cero(v)) return;
+        poli_fijar_longitud(p, i + 1);
+    }
+    bg_copiar_en(&p->c[i], v);
+    poli_normalizar(p);
+}
+
+// Coeficientes separados por espacios, de x^0 hacia arriba: "5 0 -1" es
+// 5 - x^2
+BigPoli* bg_poli_desde_cadena(const char *s) {
+    BigPoli *p = bg_poli_nuevo();
+    size_t i = 0;
+    while (*s) {
+        while (*s == ' ') s++;
+        const char *fin = s;
+        while (*fin && *fin != ' ') fin++;
+        if (fin == s) break;
+        char *trozo = malloc(fin - s + 1);
+        memcpy(trozo, s, fin - s);
+        trozo[fin - s] = '\0';
+        BigInt *c = bg_desde_cadena(trozo);
+        poli_fijar_longitud(p, i + 1);
+        bg_copiar_en(&p->c[i++], c);
+        bg_liberar(c);
+        free(trozo);
+        s = fin;
+    }
+    poli_normalizar(p);
+    return p;
+}
+
+// Lo contrario de bg_poli_desde_cadena; "0" para el polinomio cero
+char* bg_poli_a_cadena(const BigPoli *p) {
+    if (p->longitud == 0) {
+        char *s = malloc(2);
+        strcpy(s, "0");
+        return s;
+    }
+    char **partes = malloc(p->longitud * sizeof(char *));
+    size_t total = 0;
+    for (size_t i = 0; i < p->longitud; i++) {
+        partes[i] = bg_a_cadena(&p->c[i]);
+        total += strlen(partes[i]) + 1;
+    }
+    char *s = malloc(total), *w = s;
+    for (size_t i = 0; i < p->longitud; i++) {
+        size_t l = strlen(partes[i]);
+        memcpy(w, partes[i], l);
+        w += l;
+        *w++ = i + 1 < p->longitud ? ' ' : '\0';
+        free(partes[i]);
+    }
+    free(partes);
+    return s;
+}
+
+static void poli_sumar_into(BigPoli *dst, const BigPoli *a, const BigPoli *b, int signo_b) {
+    size_t na = a->longitud, nb = b->longitud;
+    size_t n = na > nb ? na : nb;
+    poli_fijar_longitud(dst, n);
+    for (size_t i = 0; i < n; i++) {
+        BigInt *c = &dst->c[i];
+        if (i >= nb) bg_copiar_en(c, &a->c[i]);
+        else if (i >= na) {
+            bg_copiar_en(c, &b->c[i]);
+            if (!bg_es_cero(c)) c->signo *= signo_b;
+        } else sumar_en(c, &a->c[i], &b->c[i], signo_b * b->c[i].signo);
+    }
+    poli_normalizar(dst);
+}
+
+void bg_poli_add_into(BigPoli *dst, const BigPoli *a, const BigPoli *b) {
+    poli_sumar_into(dst, a, b, +1);
+}
+
+void bg_poli_sub_into(BigPoli *dst, const BigPoli *a, const BigPoli *b) {
+    poli_sumar_into(dst, a, b, -1);
+}
+
+// dst = a * b por sustitución de Kronecker
+void bg_poli_mul_into(BigPoli *dst, const BigPoli *a, const BigPoli *b) {
+    if (a->longitud == 0 || b->longitud == 0) {
+        dst->longitud = 0;
+        return;
+    }
+    BG_OP_INICIO();
+    BgArena *previa = bg_temporal_abrir();
+    size_t k = poli_bloques(a) + poli_bloques(b) + 1;
+    size_t n = a->longitud + b->longitud - 1;
+    BigInt *za = bg_nuevo(), *zb = bg_nuevo();
+    poli_empaquetar(za, a, k);
+    if (a == b) {
+        bg_square_into(za, za);
+    } else {
+        poli_empaquetar(zb, b, k);
+        bg_mul_into(za, za, zb);
+    }
+    poli_desempaquetar(dst, za, n, k);
+    bg_temporal_cerrar(previa);
+    BG_OP_FIN(BG_OP_POLINOMIO);
+}
+
+// lc(b)^(m-n+1) a = q b + r con grado r < grado b (m y n los grados de a
+// y b); q o r pueden ser NULL
+void bg_poli_pseudo_divrem(const BigPoli *a, const BigPoli *b, BigPoli *q, BigPoli *r) {
+    if (b->longitud == 0) {
+        fprintf(stderr, "Error: División por el polinomio cero\n");
+        exit(1);
+    }
+    BG_OP_INICIO();
+    BgArena *previa = bg_temporal_abrir();
+    BigPoli *u = bg_poli_nuevo(), *v = bg_poli_nuevo(), *c = bg_poli_nuevo();
+    poli_copiar_en(u, a);
+    poli_copiar_en(v, b);
+    poli_pseudo_divrem(c, u, v);
+    if (q) poli_copiar_en(q, c);
+    if (r) poli_copiar_en(r, u);
+    bg_poli_liberar(u);
+    bg_poli_liberar(v);
+    bg_poli_liberar(c);
+    bg_temporal_cerrar(previa);
+    BG_OP_FIN(BG_OP_POLINOMIO);
+}
+
+// dst = mcd de a y b en Z[x] por restos primitivos: cada pseudorresto se
+// divide por su contenido. Sale con el coeficiente principal positivo.
+void bg_poli_gcd_into(BigPoli *dst, const BigPoli *a, const BigPoli *b) {
+    BG_OP_INICIO();
+    BgArena *previa = bg_temporal_abrir();
+    BigPoli *u = bg_poli_nuevo(), *v = bg_poli_nuevo(), *q = bg_poli_nuevo();
+    BigInt *g = bg_nuevo(), *h = bg_nuevo();
+    poli_copiar_en(u, a);
+    poli_copiar_en(v, b);
+    if (u->longitud < v->longitud) {
+        BigPoli *t = u;
+        u = v;
+        v = t;
+    }
+    poli_contenido(g, u);
+    poli_contenido(h, v);
+    bg_gcd_into(g, g, h);
+    poli_primitivo(u);
+    poli_primitivo(v);
+    while (v->longitud > 0) {
+        poli_pseudo_divrem(q, u, v);
+        poli_primitivo(u);
+        BigPoli *t = u;
+        u = v;
+        v = t;
     }
+    if (u->longitud == 0) {
+        dst->longitud = 0;
+    } else {
+        poli_escalar(dst, u, g);
+    }
+    bg_poli_liberar(u);
+    bg_poli_liberar(v);
+    bg_poli_liberar(q);
+    bg_temporal_cerrar(previa);
+    BG_OP_FIN(BG_OP_POLINOMIO);
+}
 
-    // Si pHigh está vacío, agregar un 0
-    if ((*pHigh)->longitud == 0) {
-        bg_append(*pHigh, 0);
+// ---------------------------------------------------------------------
+// Lotes de operaciones independientes
+//
+// bg_lote reparte entre los hilos de bg_hilos_fijar un arreglo de
+// operaciones sin relación entre sí. Los trabajos se clasifican por coste
+// estimado en clases de potencias de dos, de la más cara a la más barata,
+// y dentro de cada clase conservan el orden de la entrada: recorrerlos en
+// orden de coste exacto salta por la memoria de los operandos y, con
+// operaciones pequeñas, eso cuesta más que la propia aritmética. Por lo
+// mismo, todo lo que cuesta menos de LOTE_COSTE_MENOR va en una sola
+// clase. Después se cortan en grupos consecutivos de coste parecido: cada
+// grupo trae operandos de tamaños cercanos y los grandes van solos y
+// primero. Cada grupo es una tarea del grupo de hilos que deja abierto un
+// ámbito temporal mientras dura, así que sus operaciones reciclan el
+// espacio de trabajo en la arena de su hilo sin vaciarla entre una y
+// otra. Los resultados quedan en el heap, cada uno en su trabajo, en el
+// orden de la entrada.
+// ---------------------------------------------------------------------
+
+#define LOTE_GRUPOS_POR_HILO 8   // grupos por hilo para repartir la cola
+
+// Coste aproximado en operaciones de bloque: lineal para sumas y, para
+// productos, escolar hasta el umbral de Karatsuba y tres medios productos por
+// cada duplicación por encima. La división cuesta como el producto del
+// cociente por el divisor. Solo sirve para ordenar y agrupar.
+static double lote_coste_mul(double an, double bn) {
+    if (an < bn) { double t = an; an = bn; bn = t; }
+    double f = bn;
+    while (bn >= 2 * bg_umbral.karatsuba) {
+        bn /= 2;
+        f = f * 3 / 4;
     }
+    return an * f;
 }
 
-//Multiplicación con Karatsuba:
-BigInt* bg_multiplicarKaratsuba(const BigInt *a, const BigInt *b) {
-    //Caso base: si es muy pequeño, usar naive
-    const size_t UMBRAL = 2;
-    if (a->longitud <= UMBRAL || b->longitud <= UMBRAL) {
-        return multiplicar(a, b);
+static double lote_coste(const BgTrabajo *t) {
+    double an = t->a->longitud;
+    double bn = t->op == BG_CUADRADO ? an : t->b->longitud;
+    switch (t->op) {
+    case BG_MULTIPLICAR:
+    case BG_CUADRADO:
+        return lote_coste_mul(an, bn);
+    case BG_DIVIDIR:
+        return an > bn ? lote_coste_mul(an - bn + 1, bn) : bn;
+    default:
+        return an > bn ? an : bn;
     }
+}
 
-    // Usar la longitud del número más grande para m
-    size_t max_len = (a->longitud > b->longitud) ? a->longitud : b->longitud;
-    size_t m = max_len / 2;
+static void lote_ejecutar(BgTrabajo *t) {
+    t->resto = NULL;
+    if (t->op == BG_DIVIDIR) {
+        t->r = bg_dividir_largo(t->a, t->b, &t->resto);
+        return;
+    }
+    t->r = bg_nuevo();
+    switch (t->op) {
+    case BG_SUMAR:       bg_add_into(t->r, t->a, t->b); break;
+    case BG_RESTAR:      bg_sub_into(t->r, t->a, t->b); break;
+    case BG_MULTIPLICAR: bg_mul_into(t->r, t->a, t->b); break;
+    case BG_CUADRADO:    bg_square_into(t->r, t->a); break;
+    case BG_DIVIDIR:     break;
+    }
+}
 
-    //Partir a y b en baja/alta:
-    BigInt *lowA, *highA, *lowB, *highB;
-    bg_split(a, m, &lowA, &highA);
-    bg_split(b, m, &lowB, &highB);
+typedef struct {
+    BgTarea tarea;
+    BgTrabajo *trabajos;
+    const size_t *orden;       // índices de este grupo; NULL, los n primeros
+    size_t n;
+} BgTareaLote;
+
+static void lote_grupo(BgTarea *tarea) {
+    BgTareaLote *g = (BgTareaLote *)tarea;
+    BgArena *previa = bg_temporal_abrir();
+    bg_arena_activar(NULL);                     // resultados en el heap
+    for (size_t i = 0; i < g->n; i++)
+        lote_ejecutar(&g->trabajos[g->orden ? g->orden[i] : i]);
+    bg_temporal_cerrar(previa);
+}
 
-    //3 productos recursivos
-    BigInt *z0 = bg_multiplicarKaratsuba(lowA, lowB);        // low * low
-    BigInt *z2 = bg_multiplicarKaratsuba(highA, highB);      // high * high
+#define LOTE_CLASES 64
+#define LOTE_COSTE_MENOR 1024.0  // por debajo, una sola clase en orden de entrada
 
-    // (lowA + highA) * (lowB + highB)
-    BigInt *sumA = bg_sumar_magnitud(lowA, highA);
-    BigInt *sumB = bg_sumar_magnitud(lowB, highB);
-    BigInt *z1_temp = bg_multiplicarKaratsuba(sumA, sumB);
+// Clase de coste: parte entera de log2, o 0 para las operaciones pequeñas
+static int lote_clase(double coste) {
+    if (coste < LOTE_COSTE_MENOR) return 0;
+    int c = 0;
+    while (coste >= 2 && c < LOTE_CLASES - 1) {
+        coste /= 2;
+        c++;
+    }
+    return c;
+}
 
-    //z1 = z1_temp - z2 - z0
-    BigInt *temp1 = bg_restar_magnitud(z1_temp, z2);
-    BigInt *z1 = bg_restar_magnitud(temp1, z0);
+// Ejecuta los n trabajos y deja en cada uno su resultado, que el llamador
+// libera con bg_liberar. Sin hilos los hace en orden en este hilo.
+void bg_lote(BgTrabajo *trabajos, size_t n) {
+    if (n == 0) return;
+    if (bg_hilos() == 1) {
+        BgTareaLote g = { .trabajos = trabajos, .orden = NULL, .n = n };
+        lote_grupo(&g.tarea);
+        return;
+    }
 
-    //r = z2 * BASE^(2m) + z1 * BASE^m + z0
-    BigInt *z2_shifted = bg_shift(z2, 2*m);
-    BigInt *z1_shifted = bg_shift(z1, m);
+    // Los arreglos del reparto salen de la arena temporal, que se
+    // conserva de una llamada a otra
+    BgArena *previa = bg_temporal_abrir();
+    double *costes = bg_arena_reservar(arena_temporal, n * sizeof(double));
+    unsigned char *clases = bg_arena_reservar(arena_temporal, n);
+    size_t *orden = bg_arena_reservar(arena_temporal, n * sizeof(size_t));
+    BgTareaLote *grupos = bg_arena_reservar(arena_temporal, n * sizeof(BgTareaLote));
+
+    // Orden estable por clase, de la más cara a la más barata
+    size_t inicio[LOTE_CLASES + 1] = {0};
+    double total = 0;
+    for (size_t i = 0; i < n; i++) {
+        costes[i] = lote_coste(&trabajos[i]);
+        clases[i] = (unsigned char)(LOTE_CLASES - 1 - lote_clase(costes[i]));
+        inicio[clases[i] + 1]++;
+        total += costes[i];
+    }
+    for (int c = 0; c < LOTE_CLASES; c++) inicio[c + 1] += inicio[c];
+    for (size_t i = 0; i < n; i++) orden[inicio[clases[i]]++] = i;
+
+    // Grupos consecutivos en ese orden, cerrados al llegar a la fracción
+    // del coste total que toca a cada uno
+    double objetivo = total / (bg_hilos() * LOTE_GRUPOS_POR_HILO);
+    size_t ng = 0;
+    for (size_t i = 0; i < n; ) {
+        BgTareaLote *g = &grupos[ng++];
+        *g = (BgTareaLote){ .tarea.fn = lote_grupo, .trabajos = trabajos, .orden = orden + i };
+        double coste = 0;
+        do {
+            coste += costes[orden[i]];
+            g->n++;
+            i++;
+        } while (i < n && coste + costes[orden[i]] <= objetivo);
+        bg_tarea_lanzar(&g->tarea);
+    }
+    for (size_t i = ng; i-- > 0; )
+        bg_tarea_esperar(&grupos[i].tarea);
 
-    BigInt *temp_sum1 = sumar(z2_shifted, z1_shifted);
-    BigInt *resultado = sumar(temp_sum1, z0);
+    bg_temporal_cerrar(previa);
+}
 
-    resultado->signo = a->signo * b->signo;
+// ---------------------------------------------------------------------
+// Perfil de umbrales
+//
+// Los cruces entre algoritmos dependen de la máquina: de las cachés, de
+// la latencia del producto y de si el caso base tiene AVX2 o AVX-512.
+// bg_afinar los mide en la que ejecuta y los escribe en un perfil de
+// texto, una línea "nombre valor" por umbral; bg_perfil_cargar lo lee al
+// arrancar y, si no existe, quedan los valores compilados.
+//
+// Cada umbral se mide sobre una serie creciente de tamaños n: se
+// cronometra la operación de n bloques con el umbral en n + 1, donde el
+// nivel de arriba aún es el algoritmo menor, y en n, donde ya es el
+// mayor con los subproblemas por debajo (afinar_cruce elige el corte).
+// Se mide con un solo hilo y en el orden en que se apoyan los niveles:
+// Karatsuba con Toom-3 y NTT apagados, Toom-3 sobre ese Karatsuba, etc.
+// ---------------------------------------------------------------------
+
+#if defined(BG_DECIMAL)
+#  define BG_PERFIL_BASE "decimal"
+#elif BG_LIMB_BITS == 32
+#  define BG_PERFIL_BASE "32"
+#else
+#  define BG_PERFIL_BASE "64"
+#endif
+#define BG_PERFIL_RUTA "bg_perfil_" BG_PERFIL_BASE ".txt"   // si no se da otra
+
+#define AFINAR_REPETICIONES 5        // de cada medida se toma la mejor
+#define AFINAR_SEGUNDOS     0.005    // duración mínima de cada repetición
+#define AFINAR_MAX_BLOQUES  (1 << 16)
+#define AFINAR_PUNTOS       128      // tamaños de cada serie, como mucho
+#define AFINAR_SEGUIDAS     3        // victorias del mayor que cortan la serie
+
+// Nombre en el perfil y menor valor con el que funciona cada umbral
+static const struct {
+    const char *nombre;
+    size_t desplazamiento;
+    size_t minimo;
+} bg_umbral_campos[] = {
+    { "karatsuba",     offsetof(BgUmbrales, karatsuba),     2 },
+    { "karatsuba_sqr", offsetof(BgUmbrales, karatsuba_sqr), 2 },
+    { "toom3",         offsetof(BgUmbrales, toom3),         3 },
+    { "ntt",           offsetof(BgUmbrales, ntt),           2 },
+    { "div_newton",    offsetof(BgUmbrales, div_newton),    2 },
+    { "conv",          offsetof(BgUmbrales, conv),          2 },
+};
+#define BG_UMBRAL_CAMPOS (sizeof(bg_umbral_campos) / sizeof(bg_umbral_campos[0]))
+
+static size_t *bg_umbral_campo(BgUmbrales *u, size_t i) {
+    return (size_t *)((char *)u + bg_umbral_campos[i].desplazamiento);
+}
 
-    // Liberar memoria
-    bg_liberar(lowA);  bg_liberar(highA);
-    bg_liberar(lowB);  bg_liberar(highB);
-    bg_liberar(z0);    bg_liberar(z2);
-    bg_liberar(sumA);  bg_liberar(sumB);
-    bg_liberar(z1_temp); bg_liberar(temp1);
-    bg_liberar(z1);
-    bg_liberar(z2_shifted); bg_liberar(z1_shifted);
-    bg_liberar(temp_sum1);
+// Lee un perfil escrito por bg_afinar y fija sus umbrales; los que no
+// nombra conservan su valor. Devuelve 0 si el archivo no existe. Un
+// perfil de otra base o con líneas que no entiende es un error.
+int bg_perfil_cargar(const char *ruta) {
+    FILE *f = fopen(ruta, "r");
+    if (!f) return 0;
+
+    BgUmbrales u = bg_umbral;
+    char linea[256], nombre[64], valor[64];
+    for (int num = 1; fgets(linea, sizeof linea, f); num++) {
+        if (linea[0] == '#' || sscanf(linea, "%63s", nombre) != 1) continue;
+        if (sscanf(linea, "%63s %63s", nombre, valor) != 2) {
+            fprintf(stderr, "Error: %s:%d: falta el valor de %s\n", ruta, num, nombre);
+            exit(1);
+        }
+        if (strcmp(nombre, "base") == 0) {
+            if (strcmp(valor, BG_PERFIL_BASE) != 0) {
+                fprintf(stderr, "Error: %s es un perfil de base %s y esta es %s\n",
+                        ruta, valor, BG_PERFIL_BASE);
+                exit(1);
+            }
+            continue;
+        }
+        size_t i = 0;
+        while (i < BG_UMBRAL_CAMPOS && strcmp(nombre, bg_umbral_campos[i].nombre) != 0) i++;
+        char *fin;
+        unsigned long long v = strtoull(valor, &fin, 10);
+        if (i == BG_UMBRAL_CAMPOS || *fin != '\0' || valor[0] == '-' ||
+            v < bg_umbral_campos[i].minimo || v > SIZE_MAX) {
+            fprintf(stderr, "Error: %s:%d: umbral no válido: %s %s\n", ruta, num, nombre, valor);
+            exit(1);
+        }
+        *bg_umbral_campo(&u, i) = (size_t)v;
+    }
+    fclose(f);
+    bg_umbral = u;
+    return 1;
+}
 
-    return resultado;
+// Tiempo de procesador del hilo: las medidas son de un solo hilo y así
+// no cuenta el tiempo que otros procesos le quitan
+static double segundos_cpu(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
 }
 
+// Operandos de las medidas: a y b de AFINAR_MAX_BLOQUES bloques, r del doble
+static bg_limb *afinar_a, *afinar_b, *afinar_r;
+#ifndef BG_DECIMAL
+static char *afinar_cifras;
+#endif
 
-// Devuelve 1 si BigInt a es cero
-int bg_es_cero(const BigInt *a) {
-    return (a->longitud == 1 && a->cabeza->valor == 0);
-}
+static void afinar_mul(size_t n) { mag_multiplicar(afinar_r, afinar_a, n, afinar_b, n); }
+static void afinar_sqr(size_t n) { mag_multiplicar(afinar_r, afinar_a, n, afinar_a, n); }
 
-// Devuelve un BigInt con valor cero
-BigInt* bg_cero() {
-    BigInt *r = bg_nuevo();
-    bg_append(r, 0);
-    return r;
+// 2n bloques entre n, el caso con el que se midieron los compilados
+static void afinar_div(size_t n) {
+    mag_divrem(afinar_r, afinar_r + n + 1, afinar_a, 2 * n, afinar_b, n);
 }
 
-// Devuelve un BigInt con valor uno
-BigInt* bg_uno() {
-    BigInt *r = bg_nuevo();
-    bg_append(r, 1);
-    return r;
+#ifndef BG_DECIMAL
+// Lectura y escritura de un número de n + 1 trozos decimales
+static void afinar_conv(size_t n) {
+    size_t len = (n + 1) * BG_TROZO_DIGITOS;
+    char fin = afinar_cifras[len];
+    afinar_cifras[len] = '\0';
+    BigInt *x = bg_desde_cadena(afinar_cifras);
+    afinar_cifras[len] = fin;
+    free(bg_a_cadena(x));
+    bg_liberar(x);
 }
-
-// División larga usando multiplicación clásica
-BigInt* bg_dividir_largo(const BigInt *dividendo, const BigInt *divisor, BigInt **residuo) {
-    if (bg_es_cero(divisor)) {
-        fprintf(stderr, "Error: División por cero\n");
-        exit(1);
-    }
-    if (bg_es_cero(dividendo)) {
-        if (residuo) *residuo = bg_cero();
-        return bg_cero();
+#endif
+
+// Mejor tiempo de op(n) en AFINAR_REPETICIONES repeticiones. Cada una
+// encadena tantas llamadas como hagan falta para durar AFINAR_SEGUNDOS,
+// y así leer el reloj no pesa en las operaciones pequeñas.
+static double afinar_tiempo(void (*op)(size_t), size_t n) {
+    long veces = 1;
+    double mejor = 1e30;
+    for (int rep = 0; rep < AFINAR_REPETICIONES; ) {
+        double inicio = segundos_cpu();
+        for (long i = 0; i < veces; i++) op(n);
+        double t = segundos_cpu() - inicio;
+        if (t < AFINAR_SEGUNDOS) {
+            veces *= 2;
+            continue;
+        }
+        if (t / veces < mejor) mejor = t / veces;
+        rep++;
     }
+    return mejor;
+}
 
-    BigInt *dividendo_pos = bg_clone(dividendo);
-    BigInt *divisor_pos = bg_clone(divisor);
-    dividendo_pos->signo = 1;
-    divisor_pos->signo = 1;
+// Fija *umbral con la serie de tamaños desde..hasta, que se corta cuando
+// el algoritmo mayor gana en AFINAR_SEGUIDAS tamaños seguidos. De los
+// tamaños medidos se queda con el que menos pierde: la suma de lo que el
+// menor es más lento por debajo y lo que el mayor es más lento desde él,
+// en tanto por uno, así que una medida suelta con ruido no decide.
+static void afinar_cruce(const char *nombre, size_t *umbral, size_t compilado,
+                         size_t desde, size_t hasta, void (*op)(size_t)) {
+    size_t tam[AFINAR_PUNTOS];
+    double dif[AFINAR_PUNTOS];   // (mayor - menor) / menor
+    int k = 0, seguidas = 0;
+    for (size_t n = desde; n <= hasta && k < AFINAR_PUNTOS && seguidas < AFINAR_SEGUIDAS;
+         n += n / 8 + 1) {
+        *umbral = n + 1;
+        double menor = afinar_tiempo(op, n);
+        *umbral = n;
+        double mayor = afinar_tiempo(op, n);
+        tam[k] = n;
+        dif[k] = (mayor - menor) / menor;
+        seguidas = dif[k] < 0 ? seguidas + 1 : 0;
+        k++;
+    }
 
-    int cmp = compararBigInt(dividendo_pos, divisor_pos);
-    if (cmp < 0) {
-        if (residuo) *residuo = dividendo_pos;
-        bg_liberar(divisor_pos);
-        return bg_cero();
+    // Umbral en tam[j]: pierde -dif por debajo de j y dif desde j
+    double perdida = 0;
+    for (int i = 0; i < k; i++)
+        if (dif[i] < 0) perdida -= dif[i];
+    double mejor = perdida;
+    *umbral = seguidas ? tam[k - 1] : hasta;
+    for (int j = k - 1; j >= 0; j--) {
+        perdida += dif[j];
+        if (perdida <= mejor) {
+            mejor = perdida;
+            *umbral = tam[j];
+        }
     }
+    printf("%-14s %8zu   (compilado %zu)\n", nombre, *umbral, compilado);
+    fflush(stdout);
+}
 
-    BigInt *cociente = bg_nuevo();
-    BigInt *resto = bg_cero();
+static bg_limb afinar_bloque(void) {
+    uint64_t x = ((uint64_t)rand() << 42) ^ ((uint64_t)rand() << 21) ^ (uint64_t)rand();
+    return (bg_limb)(x % ((bg_dlimb)BG_MAX + 1)) | 1;
+}
 
-    Nodo *p = dividendo_pos->cabeza;
-    uint32_t *digitos = malloc(dividendo_pos->longitud * sizeof(uint32_t));
-    if (!digitos) {
+// Mide los umbrales en esta máquina, los deja en uso y escribe el perfil
+// en ruta. Tarda del orden de un minuto.
+void bg_afinar(const char *ruta) {
+    int hilos = bg_hilos();
+    bg_hilos_fijar(1);
+    afinar_a = malloc(AFINAR_MAX_BLOQUES * sizeof(bg_limb));
+    afinar_b = malloc(AFINAR_MAX_BLOQUES * sizeof(bg_limb));
+    afinar_r = malloc(2 * AFINAR_MAX_BLOQUES * sizeof(bg_limb));
+    if (!afinar_a || !afinar_b || !afinar_r) {
         fprintf(stderr, "Error: no se pudo reservar memoria\n");
         exit(1);
     }
-    for (size_t i = 0; i < dividendo_pos->longitud; i++) {
-        digitos[i] = p->valor;
-        p = p->sig;
-    }
-
-    for (int i = (int)dividendo_pos->longitud - 1; i >= 0; i--) {
-        BigInt *nuevo_resto = bg_shift(resto, 1);
-        bg_liberar(resto);
-        resto = nuevo_resto;
-
-        BigInt *extra = bg_nuevo();
-        bg_append(extra, digitos[i]);
-        BigInt *tmp = sumar(resto, extra);
-        bg_liberar(resto);
-        bg_liberar(extra);
-        resto = tmp;
-
-        // Estimar q
-        uint32_t q = 0;
-        if (compararBigInt(resto, divisor_pos) >= 0) {
-            // Estimar q aproximado
-            Nodo *r_top = resto->cabeza;
-            while (r_top && r_top->sig) r_top = r_top->sig;
-            Nodo *d_top = divisor_pos->cabeza;
-            while (d_top && d_top->sig) d_top = d_top->sig;
-
-            uint64_t r_val = r_top ? r_top->valor : 0;
-            uint64_t d_val = d_top ? d_top->valor : 1;
-            if (d_val == 0) d_val = 1;
-
-            q = (uint32_t)(r_val / d_val);
-            if (q == 0) q = 1;
-
-            // Ajustar q si nos pasamos
-            BigInt *q_big = bg_nuevo();
-            bg_append(q_big, q);
-
-            BigInt *q_mul = multiplicar(divisor_pos, q_big);
-            while (compararBigInt(resto, q_mul) < 0) {
-                bg_liberar(q_mul);
-                bg_liberar(q_big);
-                q--;
-                q_big = bg_nuevo();
-                bg_append(q_big, q);
-                q_mul = multiplicar(divisor_pos, q_big);
-            }
-
-            BigInt *tmp2 = bg_restar_magnitud(resto, q_mul);
-            bg_liberar(resto);
-            resto = tmp2;
-
-            bg_liberar(q_mul);
-            bg_liberar(q_big);
-        }
-
-        bg_append(cociente, q);
+    for (size_t i = 0; i < AFINAR_MAX_BLOQUES; i++) {
+        afinar_a[i] = afinar_bloque();
+        afinar_b[i] = afinar_bloque();
     }
-
-    free(digitos);
-    bg_liberar(dividendo_pos);
-    bg_liberar(divisor_pos);
-
-    cociente->signo = dividendo->signo * divisor->signo;
-    resto->signo = dividendo->signo;
-
-    if (residuo) {
-        *residuo = resto;
-    } else {
-        bg_liberar(resto);
+    BgArena *previa = bg_temporal_abrir();
+
+    BgUmbrales *u = &bg_umbral;
+    u->toom3 = u->ntt = SIZE_MAX;
+    afinar_cruce("karatsuba", &u->karatsuba, KARATSUBA_UMBRAL, 4, 512, afinar_mul);
+    afinar_cruce("karatsuba_sqr", &u->karatsuba_sqr, KARATSUBA_SQR_UMBRAL, 4, 512, afinar_sqr);
+    afinar_cruce("toom3", &u->toom3, TOOM3_UMBRAL, 2 * u->karatsuba, 4096, afinar_mul);
+#ifdef BG_NTT
+    afinar_cruce("ntt", &u->ntt, NTT_UMBRAL, u->toom3, AFINAR_MAX_BLOQUES, afinar_mul);
+#else
+    u->ntt = NTT_UMBRAL;
+#endif
+    afinar_cruce("div_newton", &u->div_newton, DIV_NEWTON_UMBRAL, 16, 8192, afinar_div);
+#ifndef BG_DECIMAL
+    size_t max_trozos = 1024;
+    afinar_cifras = malloc((max_trozos + 1) * BG_TROZO_DIGITOS + 1);
+    for (size_t i = 0; i < (max_trozos + 1) * BG_TROZO_DIGITOS; i++)
+        afinar_cifras[i] = (char)('0' + rand() % 10);
+    afinar_cifras[0] = '7';
+    afinar_cruce("conv", &u->conv, CONV_UMBRAL, 4, max_trozos, afinar_conv);
+    free(afinar_cifras);
+#endif
+
+    bg_temporal_cerrar(previa);
+    free(afinar_a);
+    free(afinar_b);
+    free(afinar_r);
+    bg_hilos_fijar(hilos);
+
+    FILE *f = fopen(ruta, "w");
+    if (!f) {
+        fprintf(stderr, "Error: no se pudo escribir %s\n", ruta);
+        exit(1);
     }
-
-    return cociente;
+    fprintf(f, "# Umbrales medidos por bg_afinar\nbase %s\n", BG_PERFIL_BASE);
+    for (size_t i = 0; i < BG_UMBRAL_CAMPOS; i++)
+        fprintf(f, "%s %zu\n", bg_umbral_campos[i].nombre, *bg_umbral_campo(u, i));
+    fclose(f);
 }
 
 // Genera un BigInt con longitud aleatoria entre min_dig y max_dig dígitos
@@ -854,6 +5886,174 @@ void test_karatsuba_casos_limite() {
     bg_liberar(a); bg_liberar(b); bg_liberar(r);
 }
 
+void test_toom3() {
+    printf("\n--- Toom-3 ---\n");
+
+    // Operandos por encima de TOOM3_UMBRAL, iguales y dispares
+    int tamanos[][2] = { {20000, 20000}, {20000, 15000}, {30000, 21000} };
+    for (int i = 0; i < 3; i++) {
+        BigInt *a = random_bigint(tamanos[i][0], tamanos[i][0]);
+        BigInt *b = random_bigint(tamanos[i][1], tamanos[i][1]);
+        BigInt *r_naive = multiplicar(a, b);
+        BigInt *r_rapida = bg_multiplicarKaratsuba(a, b);
+        printf("%d x %d dígitos: %s (esperado iguales)\n", tamanos[i][0], tamanos[i][1],
+               compararBigInt(r_naive, r_rapida) == 0 ? "iguales" : "distintos");
+        bg_liberar(a); bg_liberar(b);
+        bg_liberar(r_naive); bg_liberar(r_rapida);
+    }
+}
+
+void test_desequilibrada() {
+    printf("\n--- Multiplicación desequilibrada ---\n");
+
+    // Razones entre 3:2 y 2:1 (Toom-(3,2)) y por encima de 2:1 (troceo)
+    int tamanos[][2] = { {5000, 2900}, {30000, 17000}, {40000, 3000}, {50000, 700} };
+    for (int i = 0; i < 4; i++) {
+        BigInt *a = random_bigint(tamanos[i][0], tamanos[i][0]);
+        BigInt *b = random_bigint(tamanos[i][1], tamanos[i][1]);
+        BigInt *r_naive = multiplicar(a, b);
+        BigInt *r_rapida = bg_multiplicarKaratsuba(a, b);
+        BigInt *r_inversa = bg_multiplicarKaratsuba(b, a);
+        printf("%d x %d dígitos: %s (esperado iguales)\n", tamanos[i][0], tamanos[i][1],
+               compararBigInt(r_naive, r_rapida) == 0 && compararBigInt(r_naive, r_inversa) == 0
+                   ? "iguales" : "distintos");
+        bg_liberar(a); bg_liberar(b);
+        bg_liberar(r_naive); bg_liberar(r_rapida); bg_liberar(r_inversa);
+    }
+}
+
+void test_ntt() {
+    printf("\n--- NTT ---\n");
+
+    // Por encima de NTT_UMBRAL en todas las bases
+    int tamanos[][2] = { {200000, 200000}, {200000, 170000} };
+    for (int i = 0; i < 2; i++) {
+        BigInt *a = random_bigint(tamanos[i][0], tamanos[i][0]);
+        BigInt *b = random_bigint(tamanos[i][1], tamanos[i][1]);
+        BigInt *r_naive = multiplicar(a, b);
+        BigInt *r_rapida = bg_multiplicarKaratsuba(a, b);
+        printf("%d x %d dígitos: %s (esperado iguales)\n", tamanos[i][0], tamanos[i][1],
+               compararBigInt(r_naive, r_rapida) == 0 ? "iguales" : "distintos");
+        bg_liberar(a); bg_liberar(b);
+        bg_liberar(r_naive); bg_liberar(r_rapida);
+    }
+
+    // (10^k - 1)^2 = 99...9800...01: coeficientes grandes en la convolución
+    size_t k = 200000;
+    char *s = malloc(k + 1);
+    memset(s, '9', k);
+    s[k] = '\0';
+    BigInt *a = bg_desde_cadena(s);
+    BigInt *r = bg_multiplicarKaratsuba(a, a);
+    char *c = bg_a_cadena(r);
+    int ok = strlen(c) == 2 * k && c[k - 1] == '8' && c[2 * k - 1] == '1';
+    for (size_t i = 0; i + 1 < k; i++) ok &= c[i] == '9' && c[k + i] == '0';
+    printf("(10^%zu - 1)^2: %s (esperado correcto)\n", k, ok ? "correcto" : "incorrecto");
+    free(c); free(s);
+    bg_liberar(a); bg_liberar(r);
+}
+
+void test_cuadrado() {
+    printf("\n--- Cuadrado ---\n");
+
+    // bg_square contra la multiplicación de dos copias distintas, en cada
+    // nivel: escolar, Karatsuba, Toom-3 y NTT
+    int tamanos[] = { 1, 5, 300, 3000, 20000, 200000 };
+    for (int i = 0; i < 6; i++) {
+        BigInt *a = random_bigint(tamanos[i], tamanos[i]);
+        a->signo = -1;
+        BigInt *copia = bg_clone(a);
+        BigInt *r_mul = bg_multiplicarKaratsuba(a, copia);
+        BigInt *r_sqr = bg_square(a);
+        BigInt *r_naive = multiplicar(a, a);
+        printf("%d dígitos: %s (esperado iguales)\n", tamanos[i],
+               compararBigInt(r_mul, r_sqr) == 0 && compararBigInt(r_mul, r_naive) == 0
+                   ? "iguales" : "distintos");
+        bg_liberar(a); bg_liberar(copia);
+        bg_liberar(r_mul); bg_liberar(r_sqr); bg_liberar(r_naive);
+    }
+
+    // En el mismo sitio: a = a^2
+    BigInt *a = bg_desde_cadena("-123456789012345678901234567890");
+    bg_square_into(a, a);
+    char *c = bg_a_cadena(a);
+    printf("(-123456789012345678901234567890)^2 = %s\n", c);
+    printf("(esperado 15241578753238836750495351562536198787501905199875019052100)\n");
+    free(c);
+    bg_liberar(a);
+}
+
+void test_hilos() {
+    printf("\n--- Multiplicación con hilos ---\n");
+
+    // Cada nivel que reparte (Karatsuba, Toom-3, Toom-(3,2), cuadrado y
+    // NTT con y sin mitades en paralelo) contra el resultado secuencial
+    int tamanos[][2] = { {40000, 40000}, {60000, 35000}, {60000, 0}, {1200000, 1000000} };
+    for (int i = 0; i < 4; i++) {
+        BigInt *a = random_bigint(tamanos[i][0], tamanos[i][0]);
+        BigInt *b = tamanos[i][1] ? random_bigint(tamanos[i][1], tamanos[i][1]) : a;
+        bg_hilos_fijar(1);
+        BigInt *r_sec = bg_multiplicarKaratsuba(a, b);
+        bg_hilos_fijar(4);
+        BigInt *r_par = bg_multiplicarKaratsuba(a, b);
+        printf("%d x %d dígitos con %d hilos: %s (esperado iguales)\n",
+               tamanos[i][0], tamanos[i][1] ? tamanos[i][1] : tamanos[i][0], bg_hilos(),
+               compararBigInt(r_sec, r_par) == 0 ? "iguales" : "distintos");
+        if (b != a) bg_liberar(b);
+        bg_liberar(a);
+        bg_liberar(r_sec); bg_liberar(r_par);
+    }
+    bg_hilos_fijar(1);
+}
+
+void test_lote() {
+    printf("\n--- Lotes ---\n");
+
+    // Todas las operaciones con tamaños y signos mezclados, más unos
+    // productos grandes que van en grupos propios; cada resultado contra
+    // la operación suelta
+    enum { N = 400 };
+    BgTrabajo trabajos[N];
+    for (int i = 0; i < N; i++) {
+        size_t d = i % 50 == 0 ? 30000 : 1 + rand() % 3000;
+        BigInt *a = random_bigint(d, d);
+        BigInt *b = random_bigint(1, d);
+        if (rand() % 2) a->signo = -1;
+        if (rand() % 2) b->signo = -1;
+        trabajos[i] = (BgTrabajo){ .op = (BgOperacion)(i % 5), .a = a, .b = b };
+    }
+    bg_hilos_fijar(4);
+    int hilos = bg_hilos();
+    bg_lote(trabajos, N);
+    bg_hilos_fijar(1);
+
+    int iguales = 0;
+    for (int i = 0; i < N; i++) {
+        BgTrabajo *t = &trabajos[i];
+        BigInt *r = bg_nuevo(), *resto = NULL;
+        switch (t->op) {
+        case BG_SUMAR:       bg_add_into(r, t->a, t->b); break;
+        case BG_RESTAR:      bg_sub_into(r, t->a, t->b); break;
+        case BG_MULTIPLICAR: bg_mul_into(r, t->a, t->b); break;
+        case BG_CUADRADO:    bg_square_into(r, t->a); break;
+        case BG_DIVIDIR:
+            bg_liberar(r);
+            r = bg_dividir_largo(t->a, t->b, &resto);
+            break;
+        }
+        iguales += compararBigInt(r, t->r) == 0
+                   && (!resto || compararBigInt(resto, t->resto) == 0);
+        bg_liberar(r);
+        if (resto) bg_liberar(resto);
+        bg_liberar(t->r);
+        if (t->resto) bg_liberar(t->resto);
+        bg_liberar((BigInt *)t->a);
+        bg_liberar((BigInt *)t->b);
+    }
+    printf("%d de %d trabajos con %d hilos iguales a la operación suelta (esperado %d de %d)\n",
+           iguales, N, hilos, N, N);
+}
+
 void test_division() {
     printf("\nTest División larga\n");
 
@@ -881,39 +6081,1037 @@ void test_division() {
     printf("Residuo: ");
     printBigInt(r);
     printf("\n");
+    printf("(esperado cociente 100000000010000000001 y residuo 0)\n");
 
     // Liberar memoria
     bg_liberar(a);
     bg_liberar(b);
     bg_liberar(q);
     bg_liberar(r);
+
+    // Cociente y divisor parecidos con todos los signos, cociente mucho
+    // más corto que el divisor y al revés: q*b + r = a, |r| < |b| y r
+    // con el signo de a
+    int casos[][4] = { {50000, 25000, 1, 1}, {50000, 25000, -1, 1}, {50000, 25000, 1, -1},
+                       {50000, 25000, -1, -1}, {60000, 59000, -1, 1}, {200000, 3000, 1, -1} };
+    for (int i = 0; i < 6; i++) {
+        a = random_bigint(casos[i][0], casos[i][0]);
+        b = random_bigint(casos[i][1], casos[i][1]);
+        a->signo = casos[i][2];
+        b->signo = casos[i][3];
+        clock_t inicio = clock();
+        q = bg_dividir_largo(a, b, &r);
+        double segundos = (double)(clock() - inicio) / CLOCKS_PER_SEC;
+        BigInt *qb = bg_multiplicarKaratsuba(q, b);
+        BigInt *reconstruido = sumar(qb, r);
+        BigInt vr = *r, vb = *b;
+        vr.signo = vb.signo = 1;
+        int ok = compararBigInt(reconstruido, a) == 0 && compararBigInt(&vr, &vb) < 0
+                 && (bg_es_cero(r) || r->signo == a->signo);
+        printf("(%c%d dígitos) / (%c%d dígitos): %s en %.3f s (esperado correcto)\n",
+               a->signo > 0 ? '+' : '-', casos[i][0], b->signo > 0 ? '+' : '-', casos[i][1],
+               ok ? "correcto" : "incorrecto", segundos);
+        bg_liberar(qb); bg_liberar(reconstruido);
+        bg_liberar(q); bg_liberar(r);
+        bg_liberar(a); bg_liberar(b);
+    }
 }
 
-//Modo benchmarking
-int main(int argc, char **argv) {
-    if (argc == 3 && strcmp(argv[1], "-bench") == 0) {
-        int n = atoi(argv[2]);
-        srand((unsigned)time(NULL));
-        BigInt *a = random_bigint(n, n);
-        BigInt *b = random_bigint(n, n);
-
-        clock_t start, end;
-        start = clock();
-        BigInt *r_naive = multiplicar(a, b);
-        end = clock();
-        printf("Naive:     %.6f s\n", (double)(end - start)/CLOCKS_PER_SEC);
-        bg_liberar(r_naive);
+void test_bits(void) {
+    printf("\n--- Operaciones de bits ---\n");
+
+    BigInt *uno = bg_uno();
+    BigInt *p = bg_shl(uno, 200);
+    char *c = bg_a_cadena(p);
+    printf("1 << 200 = %s\n", c);
+    printf("(esperado 1606938044258990275541962092341162602522202993782792835301376)\n");
+    free(c);
+    bg_shr_into(p, p, 137);
+    c = bg_a_cadena(p);
+    printf("(1 << 200) >> 137 = %s (esperado 9223372036854775808)\n", c);
+    free(c);
+
+    BigInt *n = bg_desde_cadena("-12345678901234567890123");
+    bg_shr_into(n, n, 37);
+    c = bg_a_cadena(n);
+    printf("-12345678901234567890123 >> 37 = %s (esperado -89826636403, trunca hacia cero)\n", c);
+    free(c);
+
+    // Lógicas en complemento a dos
+    BigInt *a = bg_desde_cadena("-123456789012345678901234567890");
+    BigInt *b = bg_desde_cadena("987654321098765432109876543210");
+    BigInt *r = bg_nuevo();
+    const char *nombres[] = { "and", "or", "xor" };
+    const char *esperados[] = { "985710360914275162674813760554",
+                                "-121512828827855409466171785234",
+                                "-1107223189742130572140985545788" };
+    for (int i = 0; i < 3; i++) {
+        if (i == 0) bg_and_into(r, a, b);
+        if (i == 1) bg_or_into(r, a, b);
+        if (i == 2) bg_xor_into(r, a, b);
+        c = bg_a_cadena(r);
+        printf("a %s b = %s (esperado %s)\n", nombres[i], c, esperados[i]);
+        free(c);
+    }
+    printf("bits de |a|: %zu, encendidos: %zu, bit 1: %d (esperado 97, 54, 1)\n",
+           bg_bit_length(a), bg_popcount(a), bg_test_bit(a, 1));
+
+    // División binaria contra la división larga, con signos
+    BigInt *x = random_bigint(3000, 3000);
+    BigInt *y = random_bigint(1100, 1100);
+    x->signo = -1;
+    BigInt *r1, *r2;
+    BigInt *q1 = bg_dividir_binario(x, y, &r1);
+    BigInt *q2 = bg_dividir_largo(x, y, &r2);
+    printf("División binaria 3000 / 1100 dígitos: %s (esperado iguales)\n",
+           compararBigInt(q1, q2) == 0 && compararBigInt(r1, r2) == 0 ? "iguales" : "distintos");
+
+    bg_liberar(uno); bg_liberar(p); bg_liberar(n);
+    bg_liberar(a); bg_liberar(b); bg_liberar(r);
+    bg_liberar(x); bg_liberar(y);
+    bg_liberar(q1); bg_liberar(q2); bg_liberar(r1); bg_liberar(r2);
+}
+
+// Potencia modular: valores conocidos y, con módulos grandes impar y par,
+// contra multiplicar y dividir paso a paso
+void test_powmod(void) {
+    printf("\n--- Potencia modular ---\n");
+
+    const char *casos[][4] = {
+        { "3", "170141183460469231731687303715884105726",
+          "170141183460469231731687303715884105727", "1" },
+        { "2", "1000", "1000000000000000000000000000057",
+          "141502251827270929530186206576" },
+        { "7", "12345", "10000000000000000000000000000000000000000",
+          "6839255906251102402086947654718621444807" },
+        { "-5", "3", "7", "1" },
+        { "123456789", "987654321", "18446744073709551629", "14549388910750822763" },
+        { "42", "0", "1", "0" },
+    };
+    for (size_t i = 0; i < sizeof(casos) / sizeof(casos[0]); i++) {
+        BigInt *b = bg_desde_cadena(casos[i][0]);
+        BigInt *e = bg_desde_cadena(casos[i][1]);
+        BigInt *m = bg_desde_cadena(casos[i][2]);
+        BigInt *r = bg_powmod(b, e, m);
+        char *c = bg_a_cadena(r);
+        printf("%s^%s mod %s = %s (esperado %s)\n", casos[i][0],
+               strlen(casos[i][1]) > 12 ? "e" : casos[i][1],
+               strlen(casos[i][2]) > 12 ? "m" : casos[i][2], c, casos[i][3]);
+        free(c);
+        bg_liberar(b); bg_liberar(e); bg_liberar(m); bg_liberar(r);
+    }
+
+    // Montgomery por debajo de MODULAR_REDC_UMBRAL bloques, recíproco por encima
+    size_t digitos[] = { 150, 1500 };
+    for (int k = 0; k < 2; k++) {
+        for (int par = 0; par < 2; par++) {
+            BigInt *m = random_bigint(digitos[k], digitos[k]);
+            m->bloques[0] = (m->bloques[0] & ~(bg_limb)1) | (bg_limb)!par;
+            BgModulo *md = bg_modulo_nuevo(m);
+            BigInt *g = random_bigint(2 * digitos[k], 2 * digitos[k]);
+            BigInt *e = bg_desde_cadena("77");
+            BigInt *r = bg_nuevo();
+            bg_powmod_into(r, g, e, md);
+
+            BigInt *esperado = bg_uno();
+            for (int j = 0; j < 77; j++) {
+                BigInt *t = multiplicar(esperado, g), *resto;
+                BigInt *q = bg_dividir_largo(t, m, &resto);
+                bg_liberar(esperado); bg_liberar(t); bg_liberar(q);
+                esperado = resto;
+            }
+            printf("g^77 mod m, m %s de %zu dígitos: %s (esperado iguales)\n",
+                   par ? "par" : "impar", digitos[k],
+                   compararBigInt(r, esperado) == 0 ? "iguales" : "distintos");
+
+            bg_mulmod_into(r, r, g, md);
+            bg_mul_into(esperado, esperado, g);
+            BigInt *resto, *q = bg_dividir_largo(esperado, m, &resto);
+            printf("  y por g otra vez con bg_mulmod_into: %s (esperado iguales)\n",
+                   compararBigInt(r, resto) == 0 ? "iguales" : "distintos");
+
+            bg_modulo_liberar(md);
+            bg_liberar(m); bg_liberar(g); bg_liberar(e); bg_liberar(r);
+            bg_liberar(esperado); bg_liberar(q); bg_liberar(resto);
+        }
+    }
+}
 
-        start = clock();
-        BigInt *r_kar = bg_multiplicarKaratsuba(a, b);
-        end = clock();
-        printf("Karatsuba: %.6f s\n", (double)(end - start)/CLOCKS_PER_SEC);
-        bg_liberar(r_kar);
+// Máximo común divisor: valores conocidos y, por encima del umbral del
+// medio gcd, la identidad de Bézout y el factor común construido
+void test_gcd(void) {
+    printf("\n--- Máximo común divisor ---\n");
+
+    BigInt *a = bg_desde_cadena("-123456789012345678901234567890");
+    BigInt *b = bg_desde_cadena("987654321098765432109876543210");
+    BigInt *g = bg_gcd(a, b);
+    char *c = bg_a_cadena(g);
+    printf("gcd(a, b) = %s (esperado 9000000000900000000090)\n", c);
+    free(c);
+
+    BigInt *uno = bg_uno();
+    BigInt *x = bg_shl(uno, 300), *y = bg_shl(uno, 180);
+    bg_sub_into(x, x, uno);
+    bg_sub_into(y, y, uno);
+    bg_gcd_into(g, x, y);
+    c = bg_a_cadena(g);
+    printf("gcd(2^300 - 1, 2^180 - 1) = %s (esperado 2^60 - 1 = 1152921504606846975)\n", c);
+    free(c);
+
+    BigInt *cero = bg_cero();
+    bg_gcd_into(g, cero, b);
+    printf("gcd(0, b) = b: %s\n", compararBigInt(g, b) == 0 ? "sí" : "no");
+
+    // g = s a + t b con a y b de 20000 dígitos y un factor común de 3000
+    BigInt *f = random_bigint(3000, 3000);
+    BigInt *p = random_bigint(17000, 17000), *q = random_bigint(17000, 17000);
+    bg_mul_into(p, p, f);
+    bg_mul_into(q, q, f);
+    p->signo = -1;
+    BigInt *s, *t, *resto;
+    BigInt *h = bg_gcdext(p, q, &s, &t);
+    BigInt *cociente = bg_dividir_largo(h, f, &resto);
+    printf("gcd de 20000 dígitos, múltiplo del factor común: %s\n",
+           bg_es_cero(resto) ? "sí" : "no");
+    BigInt *sa = multiplicar(s, p), *tb = multiplicar(t, q);
+    bg_add_into(sa, sa, tb);
+    bg_gcd_into(g, p, q);
+    printf("s a + t b = g: %s, gcd = gcdext: %s\n",
+           compararBigInt(sa, h) == 0 ? "sí" : "no", compararBigInt(g, h) == 0 ? "sí" : "no");
+
+    bg_liberar(a); bg_liberar(b); bg_liberar(g); bg_liberar(uno);
+    bg_liberar(x); bg_liberar(y); bg_liberar(cero); bg_liberar(f);
+    bg_liberar(p); bg_liberar(q); bg_liberar(s); bg_liberar(t); bg_liberar(h);
+    bg_liberar(cociente); bg_liberar(resto); bg_liberar(sa); bg_liberar(tb);
+}
 
-        bg_liberar(a);
-        bg_liberar(b);
+// Raíces enteras: valores conocidos, signos y potencias exactas de 20000
+// dígitos, que dan resto cero, y su vecino, que no
+void test_raices(void) {
+    printf("\n--- Raíces enteras ---\n");
+
+    BigInt *uno = bg_uno();
+    BigInt *a = bg_shl(uno, 521), *m;
+    bg_sub_into(a, a, uno);
+    BigInt *r = bg_isqrt(a, &m);
+    char *c = bg_a_cadena(r), *cm = bg_a_cadena(m);
+    printf("isqrt(2^521 - 1) = %s\n  resto %s\n", c, cm);
+    printf("(esperado 2620075888238852083761638449375348105840237839079783585978299315224216153039529\n"
+           "  resto 1956131728183669159926538792870008400963784485204425500983283458538665678515310)\n");
+    free(c); free(cm);
+    bg_liberar(a); bg_liberar(r); bg_liberar(m);
+
+    const char *casos[][4] = {
+        { "1000000000000000000000000000000000000000000000000000000000007", "3",
+          "100000000000000000000", "7" },
+        { "-30", "3", "-3", "-3" },
+        { "1267650600228229401496703205376", "100", "2", "0" },
+        { "1267650600228229401496703205375", "100", "1",
+          "1267650600228229401496703205374" },
+    };
+    for (size_t i = 0; i < sizeof(casos) / sizeof(casos[0]); i++) {
+        a = bg_desde_cadena(casos[i][0]);
+        r = bg_iroot(a, strtoul(casos[i][1], NULL, 10), &m);
+        c = bg_a_cadena(r);
+        cm = bg_a_cadena(m);
+        printf("iroot(%.12s%s, %s) = %s resto %s (esperado %s resto %s)\n", casos[i][0],
+               strlen(casos[i][0]) > 12 ? "..." : "", casos[i][1], c, cm,
+               casos[i][2], casos[i][3]);
+        free(c); free(cm);
+        bg_liberar(a); bg_liberar(r); bg_liberar(m);
+    }
+
+    unsigned long indices[] = { 2, 3, 7 };
+    for (int i = 0; i < 3; i++) {
+        unsigned long k = indices[i];
+        BigInt *x = random_bigint(20000 / k, 20000 / k), *p = bg_uno();
+        for (unsigned long j = 0; j < k; j++) bg_mul_into(p, p, x);
+        r = bg_iroot(p, k, &m);
+        int exacta = compararBigInt(r, x) == 0 && bg_es_cero(m);
+        bg_liberar(r); bg_liberar(m);
+        bg_sub_into(p, p, uno);
+        r = bg_iroot(p, k, &m);
+        bg_add_into(r, r, uno);
+        int vecino = compararBigInt(r, x) == 0 && !bg_es_cero(m);
+        printf("raíz de índice %lu de x^%lu y de x^%lu - 1, x de %lu dígitos: %s (esperado bien)\n",
+               k, k, k, 20000 / k, exacta && vecino ? "bien" : "mal");
+        bg_liberar(x); bg_liberar(p); bg_liberar(r); bg_liberar(m);
+    }
+    bg_liberar(uno);
+}
+
+// Términos de e = sum 1/k!
+static void serie_uno(BigInt *r, unsigned long k, void *datos) {
+    (void)k; (void)datos;
+    bg_fijar_entero(r, 1);
+}
+
+static void serie_e_q(BigInt *r, unsigned long k, void *datos) {
+    (void)datos;
+    bg_fijar_entero(r, k ? (long long)k : 1);
+}
+
+// Términos de Chudnovsky: 1/pi = 12 / 640320^(3/2) * sum (-1)^k (6k)! /
+// ((3k)! k!^3) (13591409 + 545140134 k) / 640320^(3k)
+static void serie_pi_a(BigInt *r, unsigned long k, void *datos) {
+    (void)datos;
+    bg_fijar_entero(r, 13591409 + 545140134LL * (long long)k);
+}
+
+static void serie_pi_p(BigInt *r, unsigned long k, void *datos) {
+    (void)datos;
+    long long n = (long long)k;
+    bg_fijar_entero(r, k ? -(6 * n - 5) * (2 * n - 1) * (6 * n - 1) : 1);
+}
+
+static void serie_pi_q(BigInt *r, unsigned long k, void *datos) {
+    (void)datos;
+    long long n = (long long)k;
+    bg_fijar_entero(r, k ? n * n * n * 10939058860032000LL : 1);   // 640320^3 / 24
+}
+
+// 10^n
+static BigInt* potencia_diez(size_t n) {
+    char *s = malloc(n + 2);
+    s[0] = '1';
+    memset(s + 1, '0', n);
+    s[n + 1] = '\0';
+    BigInt *r = bg_desde_cadena(s);
+    free(s);
+    return r;
+}
+
+void test_productos(void) {
+    printf("\n--- Productos y series ---\n");
+
+    BigInt *r = bg_factorial(25);
+    char *c = bg_a_cadena(r);
+    printf("25! = %s (esperado 15511210043330985984000000)\n", c);
+    free(c); bg_liberar(r);
+
+    r = bg_binomial(100, 50);
+    c = bg_a_cadena(r);
+    printf("C(100, 50) = %s (esperado 100891344545564193334812497256)\n", c);
+    free(c); bg_liberar(r);
+
+    r = bg_binomial(5, 7);
+    c = bg_a_cadena(r);
+    printf("C(5, 7) = %s (esperado 0)\n", c);
+    free(c); bg_liberar(r);
+
+    r = bg_primorial(30);
+    c = bg_a_cadena(r);
+    printf("30# = %s (esperado 6469693230)\n", c);
+    free(c); bg_liberar(r);
+
+    // n! contra el producto uno a uno, y C(n, k) contra n! / (k! (n-k)!)
+    unsigned long n = 3000, k = 1234;
+    BigInt *f = bg_factorial(n), *lento = bg_uno();
+    for (unsigned long i = 2; i <= n; i++) {
+        BigInt *t = bg_cero();
+        bg_addmul_word_into(t, lento, (bg_limb)i);
+        bg_liberar(lento);
+        lento = t;
+    }
+    int bien = compararBigInt(f, lento) == 0;
+    BigInt *fk = bg_factorial(k), *fnk = bg_factorial(n - k);
+    bg_mul_into(fk, fk, fnk);
+    BigInt *b = bg_binomial(n, k);
+    bg_mul_into(b, b, fk);
+    bien = bien && compararBigInt(b, f) == 0;
+    printf("3000! y C(3000, 1234) contra los productos directos: %s (esperado bien)\n",
+           bien ? "bien" : "mal");
+    bg_liberar(f); bg_liberar(lento); bg_liberar(fk); bg_liberar(fnk); bg_liberar(b);
+
+    // e con 50 decimales: floor(10^50 T / Q)
+    BgSerie e = { serie_uno, NULL, serie_uno, serie_e_q, NULL };
+    BigInt *Q = bg_nuevo(), *T = bg_nuevo(), *diez = potencia_diez(50);
+    bg_serie(&e, 0, 60, NULL, Q, NULL, T);
+    bg_mul_into(T, T, diez);
+    r = bg_dividir_largo(T, Q, NULL);
+    c = bg_a_cadena(r);
+    printf("e = %.1s.%s\n(esperado 2.71828182845904523536028747135266249775724709369995)\n",
+           c, c + 1);
+    free(c); bg_liberar(r); bg_liberar(diez);
+
+    // pi con 50 decimales: 426880 sqrt(10005) Q / T, con 10 cifras de guarda
+    BgSerie pi = { serie_pi_a, NULL, serie_pi_p, serie_pi_q, NULL };
+    bg_serie(&pi, 0, 6, NULL, Q, NULL, T);
+    BigInt *x = potencia_diez(120), *y = bg_nuevo();
+    bg_addmul_word_into(y, x, 10005);
+    BigInt *raiz = bg_isqrt(y, NULL);
+    bg_fijar_entero(y, 426880);
+    bg_mul_into(Q, Q, raiz);
+    bg_mul_into(Q, Q, y);
+    diez = potencia_diez(10);
+    bg_mul_into(T, T, diez);
+    r = bg_dividir_largo(Q, T, NULL);
+    c = bg_a_cadena(r);
+    printf("pi = %.1s.%s\n(esperado 3.14159265358979323846264338327950288419716939937510)\n",
+           c, c + 1);
+    free(c); bg_liberar(r); bg_liberar(diez); bg_liberar(raiz);
+    bg_liberar(x); bg_liberar(y); bg_liberar(Q); bg_liberar(T);
+}
+
+void test_racionales(void) {
+    printf("\n--- Racionales ---\n");
+
+    const char *casos[][4] = {
+        { "1/2", "-", "1/3", "1/6" },
+        { "-3/4", "/", "6/-8", "1" },
+        { "10/4", "*", "6/15", "1" },
+        { "7/12", "+", "5/12", "1" },
+        { "123456789012345678901234567890/7", "-", "123456789012345678901234567890/7", "0" },
+    };
+    for (size_t i = 0; i < sizeof(casos) / sizeof(casos[0]); i++) {
+        BigRat *a = bg_rat_desde_cadena(casos[i][0]), *b = bg_rat_desde_cadena(casos[i][2]);
+        BigRat *r = bg_rat_nuevo();
+        switch (casos[i][1][0]) {
+        case '+': bg_rat_add_into(r, a, b); break;
+        case '-': bg_rat_sub_into(r, a, b); break;
+        case '*': bg_rat_mul_into(r, a, b); break;
+        default:  bg_rat_div_into(r, a, b); break;
+        }
+        char *c = bg_rat_a_cadena(r);
+        printf("%s %s %s = %s (esperado %s)\n", casos[i][0], casos[i][1], casos[i][2], c,
+               casos[i][3]);
+        free(c);
+        bg_rat_liberar(a); bg_rat_liberar(b); bg_rat_liberar(r);
+    }
+
+    // La misma suma, reduciendo en cada paso y aplazándolo: sum 1/k y
+    // sum (-1)^k k / (k + 1) para k hasta 2000
+    BigRat *h[2], *g[2], *x = bg_rat_nuevo();
+    BigInt *n = bg_nuevo(), *d = bg_nuevo();
+    for (int m = 0; m < 2; m++) {
+        h[m] = bg_rat_nuevo();
+        g[m] = bg_rat_nuevo();
+        h[m]->presupuesto = g[m]->presupuesto = m ? 1000 : 0;
+        for (long long k = 1; k <= 2000; k++) {
+            bg_fijar_entero(n, 1);
+            bg_fijar_entero(d, k);
+            bg_rat_fijar(x, n, d);
+            bg_rat_add_into(h[m], h[m], x);
+            bg_fijar_entero(n, k % 2 ? -k : k);
+            bg_fijar_entero(d, k + 1);
+            bg_rat_fijar(x, n, d);
+            bg_rat_add_into(g[m], g[m], x);
+        }
+    }
+    int bien = h[0]->reducido && bg_rat_comparar(h[0], h[1]) == 0 &&
+               bg_rat_comparar(g[0], g[1]) == 0;
+    bg_rat_reducir(h[1]);
+    bg_rat_reducir(g[1]);
+    bien = bien && compararBigInt(h[0]->num, h[1]->num) == 0 &&
+           compararBigInt(h[0]->den, h[1]->den) == 0 &&
+           compararBigInt(g[0]->num, g[1]->num) == 0 &&
+           compararBigInt(g[0]->den, g[1]->den) == 0;
+    printf("sumas reducidas en cada paso y al final: %s (esperado bien)\n",
+           bien ? "bien" : "mal");
+
+    bg_fijar_entero(n, 10);
+    bg_fijar_entero(d, 1);
+    bg_rat_fijar(x, n, d);
+    printf("H(2000) %s 10 (esperado <)\n", bg_rat_comparar(h[0], x) < 0 ? "<" : ">=");
+    for (int m = 0; m < 2; m++) {
+        bg_rat_liberar(h[m]);
+        bg_rat_liberar(g[m]);
+    }
+    bg_rat_liberar(x);
+    bg_liberar(n); bg_liberar(d);
+}
+
+void test_polinomios(void) {
+    printf("\n--- Polinomios ---\n");
+
+    const char *productos[][3] = {
+        { "-1 0 1", "1 0 1", "-1 0 0 0 1" },
+        { "1 -1", "1 1 1", "1 0 0 -1" },
+        { "-18446744073709551615 1", "18446744073709551615 1",
+          "-340282366920938463426481119284349108225 0 1" },
+        { "0", "1 2 3", "0" },
+    };
+    for (size_t i = 0; i < sizeof(productos) / sizeof(productos[0]); i++) {
+        BigPoli *a = bg_poli_desde_cadena(productos[i][0]);
+        BigPoli *b = bg_poli_desde_cadena(productos[i][1]);
+        bg_poli_mul_into(a, a, b);
+        char *c = bg_poli_a_cadena(a);
+        printf("(%s) * (%s) = %s (esperado %s)\n", productos[i][0], productos[i][1], c,
+               productos[i][2]);
+        free(c);
+        bg_poli_liberar(a); bg_poli_liberar(b);
+    }
+
+    // Ejemplo de Knuth: pseudorresto -15x^4 + 3x^2 - 9 y mcd 1
+    BigPoli *a = bg_poli_desde_cadena("-5 2 8 -3 -3 0 1 0 1");
+    BigPoli *b = bg_poli_desde_cadena("21 -9 -4 0 5 0 3");
+    BigPoli *q = bg_poli_nuevo(), *r = bg_poli_nuevo();
+    bg_poli_pseudo_divrem(a, b, q, r);
+    char *cq = bg_poli_a_cadena(q), *cr = bg_poli_a_cadena(r);
+    printf("pseudodivisión: q = %s, r = %s (esperado -6 0 9, -9 0 3 0 -15)\n", cq, cr);
+    free(cq); free(cr);
+    bg_poli_gcd_into(r, a, b);
+    cr = bg_poli_a_cadena(r);
+    printf("mcd = %s (esperado 1)\n", cr);
+    free(cr);
+    bg_poli_liberar(a); bg_poli_liberar(b);
+
+    a = bg_poli_desde_cadena("-6 -3 3");            // 3 (x + 1)(x - 2)
+    b = bg_poli_desde_cadena("30 36 6");            // 6 (x + 1)(x + 5)
+    bg_poli_gcd_into(r, a, b);
+    cr = bg_poli_a_cadena(r);
+    printf("mcd(3x^2 - 3x - 6, 6x^2 + 36x + 30) = %s (esperado 3 3)\n", cr);
+    free(cr);
+    bg_poli_liberar(a); bg_poli_liberar(b);
+
+    // Kronecker contra el producto término a término, y la identidad
+    // lc(b)^(m-n+1) a = q b + r, con coeficientes de 100 dígitos
+    size_t n = 200;
+    a = bg_poli_nuevo();
+    b = bg_poli_nuevo();
+    for (size_t i = 0; i < n; i++) {
+        BigInt *x = random_bigint(100, 100), *y = random_bigint(100, 100);
+        if (i % 3 == 0) x->signo = -1;
+        if (i % 5 == 0) y->signo = -1;
+        bg_poli_fijar_coef(a, i, x);
+        bg_poli_fijar_coef(b, i / 2, y);
+        bg_liberar(x); bg_liberar(y);
+    }
+    BigPoli *p = bg_poli_nuevo();
+    bg_poli_mul_into(p, a, b);
+    BigInt *t = bg_nuevo(), **suma = malloc((a->longitud + b->longitud) * sizeof(BigInt *));
+    for (size_t i = 0; i < a->longitud + b->longitud; i++) suma[i] = bg_cero();
+    for (size_t i = 0; i < a->longitud; i++)
+        for (size_t j = 0; j < b->longitud; j++) {
+            bg_mul_into(t, &a->c[i], &b->c[j]);
+            bg_add_into(suma[i + j], suma[i + j], t);
+        }
+    int bien = p->longitud == a->longitud + b->longitud - 1;
+    for (size_t i = 0; bien && i < p->longitud; i++)
+        bien = compararBigInt(&p->c[i], suma[i]) == 0;
+    for (size_t i = 0; i < a->longitud + b->longitud; i++) bg_liberar(suma[i]);
+    free(suma);
+
+    bg_poli_pseudo_divrem(a, b, q, r);
+    bg_poli_mul_into(p, q, b);
+    bg_poli_add_into(p, p, r);
+    bg_fijar_entero(t, 1);
+    for (long i = 0; i < bg_poli_grado(a) - bg_poli_grado(b) + 1; i++)
+        bg_mul_into(t, t, &b->c[b->longitud - 1]);
+    for (size_t i = 0; i < a->longitud; i++) bg_mul_into(&a->c[i], &a->c[i], t);
+    bg_poli_sub_into(p, p, a);
+    bien = bien && p->longitud == 0 && bg_poli_grado(r) < bg_poli_grado(b);
+    printf("producto de Kronecker y pseudodivisión con %zu términos: %s (esperado bien)\n",
+           n, bien ? "bien" : "mal");
+
+    bg_liberar(t);
+    bg_poli_liberar(a); bg_poli_liberar(b); bg_poli_liberar(p);
+    bg_poli_liberar(q); bg_poli_liberar(r);
+}
+
+// Operaciones con destino: el resultado se escribe sobre un BigInt existente
+void test_operaciones_destino(void) {
+    printf("\nTest operaciones con destino\n");
+
+    BigInt *acum = bg_cero();
+    BigInt *a = bg_desde_cadena("999999999999999999");
+    BigInt *b = bg_desde_cadena("-1000000000000000000");
+
+    bg_add_into(acum, a, b);
+    printf("a + b        = "); printBigInt(acum);
+    printf("(esperado -1)\n");
+
+    bg_sub_into(acum, acum, b);          // acum -= b, con alias
+    printf("acum - b     = "); printBigInt(acum);
+    printf("(esperado 999999999999999999)\n");
+
+    bg_addmul_word_into(acum, b, 3);     // cambia de signo
+    printf("acum + 3*b   = "); printBigInt(acum);
+    printf("(esperado -2000000000000000001)\n");
+
+    bg_mul_into(acum, acum, acum);
+    printf("acum^2       = "); printBigInt(acum);
+    printf("(esperado 4000000000000000004000000000000000001)\n");
+
+    bg_liberar(acum);
+    bg_liberar(a);
+    bg_liberar(b);
+}
+
+// Uso de una arena desde código de usuario
+void test_arena(void) {
+    printf("\nTest arena\n");
+
+    BgArena *ar = bg_arena_nueva();
+    BgArena *previa = bg_arena_activar(ar);
+
+    BigInt *acum = bg_desde_cadena("1");
+    BigInt *dos  = bg_desde_cadena("2");
+    for (int i = 0; i < 100; i++) {
+        BigInt *tmp = multiplicar(acum, dos);
+        bg_liberar(acum);          // vuelve a la lista libre de la arena
+        acum = tmp;
+    }
+    bg_liberar(dos);
+    bg_arena_activar(previa);
+
+    BigInt *copia = bg_clone(acum);   // fuera de la arena
+    bg_arena_vaciar(ar);              // libera todo en bloque
+    bg_arena_destruir(ar);
+
+    printf("2^100 = "); printBigInt(copia);
+    printf("(esperado 1267650600228229401496703205376)\n");
+    bg_liberar(copia);
+}
+
+void test_conversion(void) {
+    printf("\nTest conversion decimal\n");
+
+    // 10^5000 - 1 pasa por la lectura y la escritura recursivas
+    size_t n = 5000;
+    char *nueves = malloc(n + 2);
+    nueves[0] = '-';
+    memset(nueves + 1, '9', n);
+    nueves[n + 1] = '\0';
+
+    BigInt *a = bg_desde_cadena(nueves);
+    char *s = bg_a_cadena(a);
+    printf("ida y vuelta de -(10^%zu - 1): %s (esperado iguales)\n",
+           n, strcmp(s, nueves) == 0 ? "iguales" : "distintos");
+    free(s);
+
+    // a - 1 = -10^5000
+    BigInt *uno = bg_uno();
+    bg_sub_into(a, a, uno);
+    s = bg_a_cadena(a);
+    printf("a - 1: %zu digitos, empieza por %.3s, termina en %s (esperado 5001, -10, 0)\n",
+           strlen(s) - 1, s, s + strlen(s) - 1);
+    free(s);
+
+    BigInt *c = bg_desde_cadena("-000123456789012345678901234567890");
+    printf("ceros a la izquierda: "); printBigInt(c);
+    printf("(esperado -123456789012345678901234567890)\n");
+
+    bg_liberar(a);
+    bg_liberar(c);
+    bg_liberar(uno);
+    free(nueves);
+}
+
+void test_contadores(void) {
+    printf("\nTest contadores\n");
+
+    // Un producto con hilos: los contadores de los hilos del grupo, ya
+    // parados, se suman a los del hilo principal
+    BigInt *a = random_bigint(40000, 40000);
+    BigInt *b = random_bigint(40000, 40000);
+    BigInt *r = bg_nuevo();
+    bg_contadores_reiniciar();
+    bg_hilos_fijar(4);
+    bg_mul_into(r, a, b);
+    bg_hilos_fijar(1);
+    BgContadores propio, todos;
+    bg_contadores_leer(&propio, 0);
+    bg_contadores_leer(&todos, 1);
+#ifdef BG_CONTADORES
+    printf("multiplicaciones: %" PRIu64 " (esperado 1)\n", todos.operaciones[BG_OP_MULTIPLICAR]);
+    uint64_t llamadas = 0;
+    for (int i = 0; i < BG_NIVELES; i++) llamadas += todos.llamadas[i];
+    printf("algoritmos: %s, operaciones de bloque del grupo: %s (esperado sí, sí)\n",
+           llamadas > 0 && todos.profundidad_max > 0 ? "sí" : "no",
+           todos.ops_bloque >= propio.ops_bloque && todos.ops_bloque > 0 ? "sí" : "no");
+#else
+    printf("multiplicaciones: %" PRIu64 " (esperado 0 sin -DBG_CONTADORES)\n",
+           todos.operaciones[BG_OP_MULTIPLICAR]);
+#endif
+    bg_contadores_volcar(stdout, &todos);
+    bg_liberar(a);
+    bg_liberar(b);
+    bg_liberar(r);
+}
+
+// Tiempo de reloj, que con hilos es el que importa
+static double segundos_reloj(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// ---------------------------------------------------------------------
+// Banco de medidas
+//
+// -bench mide cada operación pública sobre una serie de tamaños en
+// dígitos decimales (1, 3, 10, 30, ... entre -min y -max, más los dos
+// extremos) o sobre los de -tamanos, y escribe una fila por medida en
+// CSV o JSON. Los operandos salen de un generador con semilla
+// fija que depende solo de la semilla y del tamaño, así que dos
+// ejecuciones, aunque elijan otras operaciones, miden los mismos números.
+// Cada medida ejecuta una vez la operación para calentar y calibrar,
+// la encadena tantas veces como hagan falta para que una muestra dure
+// BENCH_MUESTRA_MIN y toma -reps muestras, o las que quepan en
+// BENCH_PRESUPUESTO con un mínimo de tres. De ellas da la mediana, los
+// percentiles 10 y 90 y el mínimo del reloj monótono, y la mediana del
+// tiempo de procesador del proceso, que con hilos suma el de todos.
+//
+// -comparar enfrenta dos CSV: una medida empeora si su mediana sube más
+// de la tolerancia y además su percentil 10 queda por encima del
+// percentil 90 de la anterior, para no confundir ruido con regresiones.
+// ---------------------------------------------------------------------
+
+#define BENCH_MAX_DIGITOS  10000000
+#define BENCH_MUESTRAS     11
+#define BENCH_MUESTRAS_MAX 101
+#define BENCH_TAMANOS_MAX  64
+#define BENCH_HILOS_MAX    1024      // -hilos; bg_hilos_fijar recorta a los que admite
+#define BENCH_MUESTRA_MIN  0.001     // segundos
+#define BENCH_PRESUPUESTO  2.0       // segundos por medida, pasadas tres muestras
+#define BENCH_TOLERANCIA   5.0       // por ciento
+
+typedef enum {
+    BENCH_SUMAR, BENCH_RESTAR, BENCH_MULTIPLICAR, BENCH_CUADRADO,
+    BENCH_DIVIDIR, BENCH_LEER, BENCH_ESCRIBIR, BENCH_OPS
+} BenchOp;
+
+static const char *bench_nombres[BENCH_OPS] = {
+    "sumar", "restar", "multiplicar", "cuadrado", "dividir", "leer", "escribir"
+};
+
+// Operandos de un tamaño: a y b de d dígitos, c de 2d para dividir entre
+// b, y a en decimal para leer
+typedef struct {
+    BigInt *a, *b, *c, *r;
+    char *cadena;
+} BenchDatos;
+
+typedef struct {
+    double mediana, p10, p90, minimo, cpu;
+    int muestras;
+    long veces;
+} BenchResultado;
+
+// Tiempo de procesador de todos los hilos del proceso
+static double segundos_proceso(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// splitmix64: reproducible en cualquier plataforma, a diferencia de rand()
+static uint64_t bench_aleatorio(uint64_t *estado) {
+    uint64_t z = (*estado += 0x9e3779b97f4a7c15u);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9u;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebu;
+    return z ^ (z >> 31);
+}
+
+// Cadena de exactamente d dígitos, el primero distinto de cero
+static char *bench_cifras(size_t d, uint64_t *estado) {
+    char *s = malloc(d + 1);
+    if (!s) {
+        fprintf(stderr, "Error: no se pudo reservar memoria\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < d; i++)
+        s[i] = (char)('0' + bench_aleatorio(estado) % 10);
+    s[0] = (char)('1' + bench_aleatorio(estado) % 9);
+    s[d] = '\0';
+    return s;
+}
+
+static BenchDatos bench_preparar(size_t d, uint64_t semilla) {
+    uint64_t estado = semilla ^ (d * 0xd1b54a32d192ed03u);
+    BenchDatos datos;
+    datos.cadena = bench_cifras(d, &estado);
+    char *b = bench_cifras(d, &estado);
+    char *c = bench_cifras(2 * d, &estado);
+    datos.a = bg_desde_cadena(datos.cadena);
+    datos.b = bg_desde_cadena(b);
+    datos.c = bg_desde_cadena(c);
+    datos.r = bg_nuevo();
+    free(b);
+    free(c);
+    return datos;
+}
+
+static void bench_descartar(BenchDatos *datos) {
+    bg_liberar(datos->a);
+    bg_liberar(datos->b);
+    bg_liberar(datos->c);
+    bg_liberar(datos->r);
+    free(datos->cadena);
+}
+
+static void bench_ejecutar(BenchOp op, BenchDatos *d) {
+    switch (op) {
+    case BENCH_SUMAR:       bg_add_into(d->r, d->a, d->b); break;
+    case BENCH_RESTAR:      bg_sub_into(d->r, d->a, d->b); break;
+    case BENCH_MULTIPLICAR: bg_mul_into(d->r, d->a, d->b); break;
+    case BENCH_CUADRADO:    bg_square_into(d->r, d->a); break;
+    case BENCH_DIVIDIR: {
+        BigInt *resto;
+        bg_liberar(bg_dividir_largo(d->c, d->b, &resto));
+        bg_liberar(resto);
+        break;
+    }
+    case BENCH_LEER:        bg_liberar(bg_desde_cadena(d->cadena)); break;
+    case BENCH_ESCRIBIR:    free(bg_a_cadena(d->a)); break;
+    default: break;
+    }
+}
+
+static int bench_orden(const void *x, const void *y) {
+    double a = *(const double *)x, b = *(const double *)y;
+    return (a > b) - (a < b);
+}
+
+// Percentil p de v[0..n) ordenado, interpolando entre vecinos
+static double bench_percentil(const double *v, int n, double p) {
+    double x = p * (n - 1);
+    int i = (int)x;
+    if (i + 1 >= n) return v[n - 1];
+    return v[i] + (x - i) * (v[i + 1] - v[i]);
+}
+
+static BenchResultado bench_medir(BenchOp op, BenchDatos *d, int reps) {
+    BenchResultado res;
+    long veces = 1;
+    for (;;) {
+        double inicio = segundos_reloj();
+        for (long i = 0; i < veces; i++) bench_ejecutar(op, d);
+        if (segundos_reloj() - inicio >= BENCH_MUESTRA_MIN) break;
+        veces *= 2;
+    }
+
+    double reloj[BENCH_MUESTRAS_MAX], cpu[BENCH_MUESTRAS_MAX];
+    int n = 0;
+    double inicio = segundos_reloj();
+    while (n < reps && (n < 3 || segundos_reloj() - inicio < BENCH_PRESUPUESTO)) {
+        double c0 = segundos_proceso(), t0 = segundos_reloj();
+        for (long i = 0; i < veces; i++) bench_ejecutar(op, d);
+        reloj[n] = (segundos_reloj() - t0) / veces;
+        cpu[n] = (segundos_proceso() - c0) / veces;
+        n++;
+    }
+    qsort(reloj, n, sizeof(double), bench_orden);
+    qsort(cpu, n, sizeof(double), bench_orden);
+    res.mediana = bench_percentil(reloj, n, 0.5);
+    res.p10 = bench_percentil(reloj, n, 0.1);
+    res.p90 = bench_percentil(reloj, n, 0.9);
+    res.minimo = reloj[0];
+    res.cpu = bench_percentil(cpu, n, 0.5);
+    res.muestras = n;
+    res.veces = veces;
+    return res;
+}
+
+static void bench_uso(void) {
+    fprintf(stderr,
+        "Uso: -bench [-min D] [-max D] [-tamanos D,D,...] [-ops op,op,...]\n"
+        "            [-reps R] [-hilos H] [-semilla S] [-json]\n"
+        "     -comparar anterior.csv nuevo.csv [tolerancia %%]\n"
+        "Operaciones: sumar restar multiplicar cuadrado dividir leer escribir\n");
+    exit(1);
+}
+
+// Valor numérico de una opción, entre min y max; si no es un entero
+// de ese rango, muestra el uso y sale
+static uint64_t bench_numero(const char *valor, uint64_t min, uint64_t max) {
+    char *fin;
+    if (!isdigit((unsigned char)valor[0])) bench_uso();
+    errno = 0;
+    unsigned long long v = strtoull(valor, &fin, 10);
+    if (errno || *fin != '\0' || v < min || v > max) bench_uso();
+    return v;
+}
+
+// Añade d a la lista ordenada de tamaños si no está
+static void bench_anotar(size_t *tamanos, int *n, size_t d) {
+    int i = 0;
+    while (i < *n && tamanos[i] < d) i++;
+    if (i < *n && tamanos[i] == d) return;
+    if (*n == BENCH_TAMANOS_MAX) bench_uso();
+    memmove(tamanos + i + 1, tamanos + i, (*n - i) * sizeof(size_t));
+    tamanos[i] = d;
+    (*n)++;
+}
+
+// -bench: mide y escribe los resultados en la salida estándar
+static int bench_principal(int argc, char **argv) {
+    size_t min = 1, max = BENCH_MAX_DIGITOS;
+    size_t tamanos[BENCH_TAMANOS_MAX];
+    int ntamanos = 0;
+    int reps = BENCH_MUESTRAS, json = 0;
+    uint64_t semilla = 1;
+    int elegidas[BENCH_OPS];
+    for (int o = 0; o < BENCH_OPS; o++) elegidas[o] = 1;
+
+    for (int i = 0; i < argc; i++) {
+        const char *valor = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "-json") == 0) { json = 1; continue; }
+        if (!valor) bench_uso();
+        if (strcmp(argv[i], "-min") == 0)          min = bench_numero(valor, 1, SIZE_MAX);
+        else if (strcmp(argv[i], "-max") == 0)     max = bench_numero(valor, 1, SIZE_MAX);
+        else if (strcmp(argv[i], "-reps") == 0)
+            reps = (int)bench_numero(valor, 1, BENCH_MUESTRAS_MAX);
+        else if (strcmp(argv[i], "-hilos") == 0)
+            bg_hilos_fijar((int)bench_numero(valor, 0, BENCH_HILOS_MAX));
+        else if (strcmp(argv[i], "-semilla") == 0) semilla = bench_numero(valor, 0, UINT64_MAX);
+        else if (strcmp(argv[i], "-tamanos") == 0) {
+            char *lista = strdup(valor), *resto = lista, *numero;
+            while ((numero = strtok_r(resto, ",", &resto)))
+                bench_anotar(tamanos, &ntamanos, bench_numero(numero, 1, SIZE_MAX));
+            free(lista);
+            if (ntamanos == 0) bench_uso();
+        } else if (strcmp(argv[i], "-ops") == 0) {
+            for (int o = 0; o < BENCH_OPS; o++) elegidas[o] = 0;
+            char *lista = strdup(valor), *resto = lista, *nombre;
+            while ((nombre = strtok_r(resto, ",", &resto))) {
+                int o = 0;
+                while (o < BENCH_OPS && strcmp(nombre, bench_nombres[o]) != 0) o++;
+                if (o == BENCH_OPS) bench_uso();
+                elegidas[o] = 1;
+            }
+            free(lista);
+        } else bench_uso();
+        i++;
+    }
+    if (min < 1 || max < min || reps < 1 || reps > BENCH_MUESTRAS_MAX) bench_uso();
+    if (ntamanos == 0) {
+        bench_anotar(tamanos, &ntamanos, min);
+        for (size_t decada = 1; decada <= max; decada *= 10) {
+            if (decada >= min) bench_anotar(tamanos, &ntamanos, decada);
+            if (3 * decada >= min && 3 * decada <= max)
+                bench_anotar(tamanos, &ntamanos, 3 * decada);
+            if (decada > max / 10) break;
+        }
+        bench_anotar(tamanos, &ntamanos, max);
+    }
+
+    if (json)
+        printf("{\"base\": \"%s\", \"hilos\": %d, \"semilla\": %" PRIu64 ", \"medidas\": [",
+               BG_PERFIL_BASE, bg_hilos(), semilla);
+    else
+        printf("# base=%s hilos=%d semilla=%" PRIu64 " reps=%d\n"
+               "op,digitos,bloques,hilos,muestras,veces,mediana_s,p10_s,p90_s,min_s,cpu_s\n",
+               BG_PERFIL_BASE, bg_hilos(), semilla, reps);
+
+    int primera = 1;
+    for (int t = 0; t < ntamanos; t++) {
+        size_t d = tamanos[t];
+        BenchDatos datos = bench_preparar(d, semilla);
+        for (int o = 0; o < BENCH_OPS; o++) {
+            if (!elegidas[o]) continue;
+            BenchResultado r = bench_medir((BenchOp)o, &datos, reps);
+            if (json)
+                printf("%s\n  {\"op\": \"%s\", \"digitos\": %zu, \"bloques\": %zu, "
+                       "\"hilos\": %d, \"muestras\": %d, \"veces\": %ld, "
+                       "\"mediana_s\": %.6e, \"p10_s\": %.6e, \"p90_s\": %.6e, "
+                       "\"min_s\": %.6e, \"cpu_s\": %.6e}",
+                       primera ? "" : ",", bench_nombres[o], d, datos.a->longitud,
+                       bg_hilos(), r.muestras, r.veces,
+                       r.mediana, r.p10, r.p90, r.minimo, r.cpu);
+            else
+                printf("%s,%zu,%zu,%d,%d,%ld,%.6e,%.6e,%.6e,%.6e,%.6e\n",
+                       bench_nombres[o], d, datos.a->longitud, bg_hilos(),
+                       r.muestras, r.veces, r.mediana, r.p10, r.p90, r.minimo, r.cpu);
+            fflush(stdout);
+            primera = 0;
+        }
+        bench_descartar(&datos);
+    }
+    if (json) printf("\n]}\n");
+    bg_hilos_fijar(1);
+    return 0;
+}
+
+typedef struct {
+    char op[16];
+    size_t digitos;
+    int hilos;
+    double mediana, p10, p90;
+} BenchFila;
+
+// Filas de un CSV de -bench; las líneas que no son medidas se saltan
+static size_t bench_leer_csv(const char *ruta, BenchFila **filas) {
+    FILE *f = fopen(ruta, "r");
+    if (!f) {
+        fprintf(stderr, "Error: no se pudo abrir %s\n", ruta);
+        exit(1);
+    }
+    size_t n = 0, cap = 64;
+    *filas = malloc(cap * sizeof(BenchFila));
+    char linea[512];
+    while (fgets(linea, sizeof linea, f)) {
+        BenchFila fila;
+        if (sscanf(linea, "%15[^,],%zu,%*[^,],%d,%*[^,],%*[^,],%lf,%lf,%lf",
+                   fila.op, &fila.digitos, &fila.hilos,
+                   &fila.mediana, &fila.p10, &fila.p90) != 6)
+            continue;
+        if (n == cap) *filas = realloc(*filas, (cap *= 2) * sizeof(BenchFila));
+        (*filas)[n++] = fila;
+    }
+    fclose(f);
+    return n;
+}
+
+// -comparar: una línea por medida común a los dos archivos; devuelve 1
+// si alguna empeoró, para usarlo en scripts
+static int bench_comparar(const char *anterior, const char *nuevo, double tolerancia) {
+    BenchFila *a, *b;
+    size_t na = bench_leer_csv(anterior, &a), nb = bench_leer_csv(nuevo, &b);
+    int peores = 0, mejores = 0, iguales = 0;
+    printf("%-12s %10s %5s %12s %12s %9s\n",
+           "op", "digitos", "hilos", "anterior_s", "nuevo_s", "cambio");
+    for (size_t j = 0; j < nb; j++) {
+        size_t i = 0;
+        while (i < na && !(strcmp(a[i].op, b[j].op) == 0 && a[i].digitos == b[j].digitos &&
+                           a[i].hilos == b[j].hilos))
+            i++;
+        if (i == na) continue;
+        double cambio = 100.0 * (b[j].mediana - a[i].mediana) / a[i].mediana;
+        const char *marca = "";
+        if (cambio > tolerancia && b[j].p10 > a[i].p90) {
+            marca = "  EMPEORA";
+            peores++;
+        } else if (cambio < -tolerancia && b[j].p90 < a[i].p10) {
+            marca = "  mejora";
+            mejores++;
+        } else {
+            iguales++;
+        }
+        printf("%-12s %10zu %5d %12.4e %12.4e %+8.1f%%%s\n", b[j].op, b[j].digitos,
+               b[j].hilos, a[i].mediana, b[j].mediana, cambio, marca);
+    }
+    printf("%d empeoran, %d mejoran, %d sin cambio (tolerancia %.1f%%)\n",
+           peores, mejores, iguales, tolerancia);
+    free(a);
+    free(b);
+    return peores > 0;
+}
+
+//Modo benchmarking
+int main(int argc, char **argv) {
+    // Perfil de umbrales: BG_PERFIL o el de la base en el directorio actual
+    const char *perfil = getenv("BG_PERFIL");
+    if (!perfil) perfil = BG_PERFIL_RUTA;
+
+    // -afinar [ruta]: mide los umbrales de esta máquina y escribe el perfil
+    if ((argc == 2 || argc == 3) && strcmp(argv[1], "-afinar") == 0) {
+        const char *destino = argc == 3 ? argv[2] : perfil;
+        bg_afinar(destino);
+        printf("Perfil escrito en %s\n", destino);
         return 0;
     }
+    bg_perfil_cargar(perfil);
+
+    // -bench [opciones]: banco de medidas en CSV o JSON; -hilos 0 usa
+    // todos los procesadores
+    if (argc >= 2 && strcmp(argv[1], "-bench") == 0)
+        return bench_principal(argc - 2, argv + 2);
+
+    // -comparar anterior.csv nuevo.csv [tolerancia]: marca regresiones
+    if ((argc == 4 || argc == 5) && strcmp(argv[1], "-comparar") == 0)
+        return bench_comparar(argv[2], argv[3], argc == 5 ? atof(argv[4]) : BENCH_TOLERANCIA);
 
     test_printBigIntNodes();
     test_compararBigInt();
@@ -921,6 +7119,24 @@ int main(int argc, char **argv) {
     test_multiplicar();
     test_tiempos_multiplicar();
     test_karatsuba_casos_limite();
+    test_toom3();
+    test_desequilibrada();
+    test_ntt();
+    test_cuadrado();
+    test_hilos();
+    test_lote();
     test_division();
+    test_bits();
+    test_powmod();
+    test_gcd();
+    test_raices();
+    test_productos();
+    test_racionales();
+    test_polinomios();
+    test_operaciones_destino();
+    test_arena();
+    test_conversion();
+    test_contadores();
+    bg_liberar_temporales();
     return 0;
 }